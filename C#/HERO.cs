@@ -18,6 +18,7 @@ namespace HERO
         public const int DEFAULT_TIMEOUT_MS = 5000;
         public const int MAX_RETRIES = 3;
         public const int FRAGMENT_HEADER_SIZE = 12;
+        public const int COOKIE_SIZE = 12;  // 4-byte time slot + 8-byte MAC
     }
 
     // Protocol flags
@@ -325,9 +326,11 @@ namespace HERO
             return pkt;
         }
 
-        public static Packet MakeConn(ushort seq, List<byte> client_pubkey)
+        // A CONN without a valid cookie (zeros) asks the server for one; a CONN
+        // carrying the server's cookie completes the handshake.
+        public static Packet MakeConn(ushort seq, List<byte> client_pubkey, List<byte> cookie = null)
         {
-            return new Packet(Flag.CONN, seq, client_pubkey, new List<byte>());
+            return new Packet(Flag.CONN, seq, client_pubkey, cookie ?? new List<byte>(new byte[Protocol.COOKIE_SIZE]));
         }
 
         public static Packet MakeGive(ushort seq, List<byte> recipient_key, List<byte> data)
@@ -483,6 +486,11 @@ namespace HERO
                             last_ping = DateTime.Now;
                             return true;
                         }
+                        if (pkt.flag == (byte)Flag.CONN && pkt.payload.Count > 0)
+                        {
+                            // Cookie challenge: echo it back with our key
+                            socket.Send(Packet.MakeConn(seq_num++, pubkey, pkt.payload).Serialize(), server_host, server_port);
+                        }
                     }
                     catch { }
                 }
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <deque>
 #include <unordered_map>
 #include <cstring>
 #include <cstdint>
@@ -14,8 +15,19 @@
 #include <thread>
 #include <sstream>
 #include <algorithm>
+#include <cmath>
 #include <tuple>
 #include <memory>
+#include <array>
+#include <random>
+#include <functional>
+#include <stdexcept>
+#include <exception>
+#include <string_view>
+#include <type_traits>
+#include <charconv>
+#include <cstdlib>
+#include <optional>
 
 #ifdef _WIN32
     #include <winsock2.h>
@@ -28,6 +40,10 @@
     #include <arpa/inet.h>
     #include <unistd.h>
     #include <fcntl.h>
+    #ifdef __linux__
+        #include <linux/filter.h>
+        #include <linux/sock_diag.h>
+    #endif
     #define SOCKET int
     #define INVALID_SOCKET -1
     #define SOCKET_ERROR -1
@@ -44,6 +60,11 @@ namespace Protocol {
     const int DEFAULT_TIMEOUT_MS = 5000;
     const int MAX_RETRIES = 3;
     const int FRAGMENT_HEADER_SIZE = 12;
+    const int HEADER_SIZE = 8;
+    const int COOKIE_SIZE = 12;          // 4-byte time slot + 8-byte MAC
+    const int COOKIE_SLOT_SECONDS = 10;  // Cookies stay valid for 1-2 slots
+    const int PING_SYNC_SIZE = 8;        // PING payload: client send time (us)
+    const int PONG_SYNC_SIZE = 40;       // PONG payload: t0, t1, t2, tick, tick time, tick interval
 }
 
 // Protocol flags
@@ -58,6 +79,539 @@ enum class Flag : uint8_t {
     PONG = 7   // Keepalive response
 };
 
+// Fixed-point float for binary encodings: sent as round(value * Scale)
+// in a zigzag varint, e.g. Fixed<100> keeps two decimal places.
+template<int Scale>
+struct Fixed {
+    static_assert(Scale > 0, "Fixed scale must be positive");
+    float value;
+
+    Fixed(float v = 0.0f) : value(v) {}
+    operator float() const { return value; }
+};
+
+// Append-only binary writer: LEB128 varints, zigzag for signed values,
+// little-endian IEEE floats.
+class ByteWriter {
+private:
+    std::vector<uint8_t>& out;
+
+public:
+    explicit ByteWriter(std::vector<uint8_t>& buffer) : out(buffer) {}
+
+    void WriteU8(uint8_t v) { out.push_back(v); }
+
+    void WriteVarUInt(uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back(static_cast<uint8_t>(v) | 0x80);
+            v >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(v));
+    }
+
+    void WriteVarInt(int64_t v) {
+        WriteVarUInt((static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63));
+    }
+
+    void WriteF32(float v) {
+        uint32_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        for (int i = 0; i < 4; i++) out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+
+    void WriteF64(double v) {
+        uint64_t bits;
+        std::memcpy(&bits, &v, sizeof(bits));
+        for (int i = 0; i < 8; i++) out.push_back(static_cast<uint8_t>(bits >> (8 * i)));
+    }
+
+    void WriteBytes(const uint8_t* data, size_t len) { out.insert(out.end(), data, data + len); }
+
+    void WriteString(std::string_view str) {
+        WriteVarUInt(str.size());
+        out.insert(out.end(), str.begin(), str.end());
+    }
+
+    size_t Size() const { return out.size(); }
+};
+
+// Bounds-checked reader over a byte range. Any read past the end fails and
+// latches Ok() to false; nothing allocates.
+class ByteReader {
+private:
+    const uint8_t* pos;
+    const uint8_t* end;
+    bool ok;
+
+public:
+    ByteReader(const uint8_t* data, size_t len) : pos(data), end(data + len), ok(true) {}
+
+    bool ReadU8(uint8_t& v) {
+        if (!ok || pos >= end) return ok = false;
+        v = *pos++;
+        return true;
+    }
+
+    bool ReadVarUInt(uint64_t& v) {
+        v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t byte;
+            if (!ReadU8(byte)) return false;
+            v |= static_cast<uint64_t>(byte & 0x7F) << shift;
+            if (!(byte & 0x80)) return true;
+        }
+        return ok = false;
+    }
+
+    bool ReadVarInt(int64_t& v) {
+        uint64_t u;
+        if (!ReadVarUInt(u)) return false;
+        v = static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1);
+        return true;
+    }
+
+    bool ReadF32(float& v) {
+        if (!ok || end - pos < 4) return ok = false;
+        uint32_t bits = 0;
+        for (int i = 0; i < 4; i++) bits |= static_cast<uint32_t>(pos[i]) << (8 * i);
+        std::memcpy(&v, &bits, sizeof(v));
+        pos += 4;
+        return true;
+    }
+
+    bool ReadF64(double& v) {
+        if (!ok || end - pos < 8) return ok = false;
+        uint64_t bits = 0;
+        for (int i = 0; i < 8; i++) bits |= static_cast<uint64_t>(pos[i]) << (8 * i);
+        std::memcpy(&v, &bits, sizeof(v));
+        pos += 8;
+        return true;
+    }
+
+    bool ReadBytes(const uint8_t*& data, size_t len) {
+        if (!ok || static_cast<size_t>(end - pos) < len) return ok = false;
+        data = pos;
+        pos += len;
+        return true;
+    }
+
+    // View into the source buffer
+    bool ReadString(std::string_view& str) {
+        uint64_t len;
+        const uint8_t* data;
+        if (!ReadVarUInt(len) || !ReadBytes(data, static_cast<size_t>(len))) return false;
+        str = std::string_view(reinterpret_cast<const char*>(data), static_cast<size_t>(len));
+        return true;
+    }
+
+    bool Ok() const { return ok; }
+    size_t Remaining() const { return static_cast<size_t>(end - pos); }
+    const uint8_t* Position() const { return pos; }
+};
+
+// Range quantization for floats: [min, max] in steps of `precision`,
+// stored in the fewest bits that still represent both endpoints.
+struct Quantization {
+    float min;
+    float max;
+    float precision;
+    int bits;
+
+    Quantization(float lo, float hi, float step) : min(lo), max(hi), precision(step), bits(1) {
+        double steps = std::ceil((static_cast<double>(hi) - lo) / step);
+        while (bits < 32 && static_cast<double>((1ULL << bits) - 1) < steps) bits++;
+    }
+
+    uint32_t Quantize(float v) const {
+        double q = std::round((static_cast<double>(v) - min) / precision);
+        double top = static_cast<double>((1ULL << bits) - 1);
+        return static_cast<uint32_t>(std::max(0.0, std::min(top, q)));
+    }
+
+    float Dequantize(uint32_t q) const {
+        return static_cast<float>(std::min<double>(max, min + static_cast<double>(q) * precision));
+    }
+};
+
+// Packs values at arbitrary bit widths, LSB first, appending to `buffer`
+// (typically the payload that is about to be sent). Call Flush() or let the
+// writer go out of scope before sending.
+class BitWriter {
+private:
+    std::vector<uint8_t>& out;
+    uint64_t scratch;
+    int scratch_bits;
+    size_t bits_written;
+
+public:
+    explicit BitWriter(std::vector<uint8_t>& buffer)
+        : out(buffer), scratch(0), scratch_bits(0), bits_written(0) {}
+
+    ~BitWriter() { Flush(); }
+
+    BitWriter(const BitWriter&) = delete;
+    BitWriter& operator=(const BitWriter&) = delete;
+
+    void WriteBits(uint32_t value, int bits) {
+        if (bits <= 0) return;
+        if (bits < 32) value &= (1u << bits) - 1;
+        scratch |= static_cast<uint64_t>(value) << scratch_bits;
+        scratch_bits += bits;
+        bits_written += bits;
+        while (scratch_bits >= 8) {
+            out.push_back(static_cast<uint8_t>(scratch));
+            scratch >>= 8;
+            scratch_bits -= 8;
+        }
+    }
+
+    void WriteBool(bool v) { WriteBits(v ? 1 : 0, 1); }
+
+    // Integer in [min, max] using just enough bits for the range
+    void WriteInt(int32_t v, int32_t min, int32_t max) {
+        uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max) - min);
+        int bits = 0;
+        while (bits < 32 && (range >> bits) != 0) bits++;
+        v = std::max(min, std::min(max, v));
+        WriteBits(static_cast<uint32_t>(static_cast<int64_t>(v) - min), bits);
+    }
+
+    void WriteFloat(float v) {
+        uint32_t raw;
+        std::memcpy(&raw, &v, sizeof(raw));
+        WriteBits(raw, 32);
+    }
+
+    void WriteQuantized(float v, const Quantization& q) { WriteBits(q.Quantize(v), q.bits); }
+
+    // Unit-length 2D direction as a quantized angle
+    void WriteUnitVector(float x, float y, int bits = 12) {
+        const double two_pi = 6.283185307179586;
+        double angle = std::atan2(static_cast<double>(y), static_cast<double>(x));
+        if (angle < 0) angle += two_pi;
+        uint32_t steps = 1u << bits;
+        WriteBits(static_cast<uint32_t>(std::llround(angle / two_pi * steps)) & (steps - 1), bits);
+    }
+
+    // 16-bit length, then bytes; longer strings are truncated
+    void WriteString(std::string_view str) {
+        size_t len = std::min<size_t>(str.size(), 0xFFFF);
+        WriteBits(static_cast<uint32_t>(len), 16);
+        for (size_t i = 0; i < len; i++) WriteBits(static_cast<uint8_t>(str[i]), 8);
+    }
+
+    void AlignToByte() { WriteBits(0, (8 - scratch_bits) & 7); }
+
+    void Flush() {
+        if (scratch_bits > 0) {
+            out.push_back(static_cast<uint8_t>(scratch));
+            bits_written += 8 - scratch_bits;
+            scratch = 0;
+            scratch_bits = 0;
+        }
+    }
+
+    size_t BitsWritten() const { return bits_written; }
+};
+
+// Reads a BitWriter stream. Reading past the end fails and latches Ok()
+// to false.
+class BitReader {
+private:
+    const uint8_t* data;
+    size_t len;
+    size_t byte_pos;
+    uint64_t scratch;
+    int scratch_bits;
+    bool ok;
+
+public:
+    BitReader(const uint8_t* buffer, size_t length)
+        : data(buffer), len(length), byte_pos(0), scratch(0), scratch_bits(0), ok(true) {}
+
+    bool ReadBits(uint32_t& value, int bits) {
+        if (!ok) return false;
+        if (bits <= 0) { value = 0; return true; }
+        while (scratch_bits < bits) {
+            if (byte_pos >= len) return ok = false;
+            scratch |= static_cast<uint64_t>(data[byte_pos++]) << scratch_bits;
+            scratch_bits += 8;
+        }
+        value = static_cast<uint32_t>(bits == 32 ? scratch : scratch & ((1ULL << bits) - 1));
+        scratch >>= bits;
+        scratch_bits -= bits;
+        return true;
+    }
+
+    bool ReadBool(bool& v) {
+        uint32_t raw;
+        if (!ReadBits(raw, 1)) return false;
+        v = raw != 0;
+        return true;
+    }
+
+    bool ReadInt(int32_t& v, int32_t min, int32_t max) {
+        uint32_t range = static_cast<uint32_t>(static_cast<int64_t>(max) - min);
+        int bits = 0;
+        while (bits < 32 && (range >> bits) != 0) bits++;
+        uint32_t raw;
+        if (!ReadBits(raw, bits)) return false;
+        v = static_cast<int32_t>(static_cast<int64_t>(min) + raw);
+        return true;
+    }
+
+    bool ReadFloat(float& v) {
+        uint32_t raw;
+        if (!ReadBits(raw, 32)) return false;
+        std::memcpy(&v, &raw, sizeof(v));
+        return true;
+    }
+
+    bool ReadQuantized(float& v, const Quantization& q) {
+        uint32_t raw;
+        if (!ReadBits(raw, q.bits)) return false;
+        v = q.Dequantize(raw);
+        return true;
+    }
+
+    bool ReadUnitVector(float& x, float& y, int bits = 12) {
+        uint32_t raw;
+        if (!ReadBits(raw, bits)) return false;
+        double angle = raw * 6.283185307179586 / (1u << bits);
+        x = static_cast<float>(std::cos(angle));
+        y = static_cast<float>(std::sin(angle));
+        return true;
+    }
+
+    bool ReadString(std::string& str) {
+        uint32_t len, byte;
+        if (!ReadBits(len, 16)) return false;
+        str.clear();
+        str.reserve(len);
+        for (uint32_t i = 0; i < len; i++) {
+            if (!ReadBits(byte, 8)) return false;
+            str.push_back(static_cast<char>(byte));
+        }
+        return true;
+    }
+
+    void AlignToByte() {
+        int drop = scratch_bits & 7;
+        scratch >>= drop;
+        scratch_bits -= drop;
+    }
+
+    bool Ok() const { return ok; }
+    size_t BytesConsumed() const { return byte_pos - static_cast<size_t>(scratch_bits / 8); }
+};
+
+namespace Detail {
+    template<typename T> struct IsFixed : std::false_type {};
+    template<int S> struct IsFixed<Fixed<S>> : std::true_type { static constexpr int scale = S; };
+
+    template<typename T> struct DependentFalse : std::false_type {};
+
+    // Wire format picked at compile time from the argument type
+    template<typename T>
+    void WriteValue(ByteWriter& w, const T& v) {
+        if constexpr (std::is_same_v<T, bool>) {
+            w.WriteU8(v ? 1 : 0);
+        } else if constexpr (std::is_enum_v<T>) {
+            WriteValue(w, static_cast<std::underlying_type_t<T>>(v));
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            w.WriteVarInt(v);
+        } else if constexpr (std::is_integral_v<T>) {
+            w.WriteVarUInt(v);
+        } else if constexpr (std::is_same_v<T, float>) {
+            w.WriteF32(v);
+        } else if constexpr (std::is_same_v<T, double>) {
+            w.WriteF64(v);
+        } else if constexpr (IsFixed<T>::value) {
+            w.WriteVarInt(std::llround(static_cast<double>(v.value) * IsFixed<T>::scale));
+        } else if constexpr (std::is_convertible_v<const T&, std::string_view>) {
+            w.WriteString(std::string_view(v));
+        } else {
+            static_assert(DependentFalse<T>::value, "Unsupported binary argument type");
+        }
+    }
+
+    template<typename T>
+    bool ReadValue(ByteReader& r, T& v) {
+        if constexpr (std::is_same_v<T, bool>) {
+            uint8_t b;
+            if (!r.ReadU8(b)) return false;
+            v = b != 0;
+            return true;
+        } else if constexpr (std::is_enum_v<T>) {
+            std::underlying_type_t<T> raw;
+            if (!ReadValue(r, raw)) return false;
+            v = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            int64_t raw;
+            if (!r.ReadVarInt(raw)) return false;
+            v = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_integral_v<T>) {
+            uint64_t raw;
+            if (!r.ReadVarUInt(raw)) return false;
+            v = static_cast<T>(raw);
+            return true;
+        } else if constexpr (std::is_same_v<T, float>) {
+            return r.ReadF32(v);
+        } else if constexpr (std::is_same_v<T, double>) {
+            return r.ReadF64(v);
+        } else if constexpr (IsFixed<T>::value) {
+            int64_t raw;
+            if (!r.ReadVarInt(raw)) return false;
+            v.value = static_cast<float>(static_cast<double>(raw) / IsFixed<T>::scale);
+            return true;
+        } else if constexpr (std::is_same_v<T, std::string_view>) {
+            return r.ReadString(v);
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            std::string_view sv;
+            if (!r.ReadString(sv)) return false;
+            v.assign(sv.data(), sv.size());
+            return true;
+        } else {
+            static_assert(DependentFalse<T>::value, "Unsupported binary argument type");
+        }
+    }
+}
+
+// Zero-copy view over an encoded command. Text commands ("CODE|a;b;")
+// expose their arguments as string_view tokens with from_chars-based typed
+// accessors; binary commands expose the raw argument bytes.
+class CommandView {
+public:
+    static constexpr uint8_t BINARY_MARK = 0x00;
+
+    class Iterator {
+    private:
+        std::string_view rest;
+        std::string_view token;
+        bool valid = false;
+
+        void Advance() {
+            size_t semi = rest.find(';');
+            valid = semi != std::string_view::npos;
+            if (valid) {
+                token = rest.substr(0, semi);
+                rest.remove_prefix(semi + 1);
+            }
+        }
+
+    public:
+        Iterator() = default;
+        explicit Iterator(std::string_view args) : rest(args) { Advance(); }
+
+        std::string_view operator*() const { return token; }
+        Iterator& operator++() { Advance(); return *this; }
+
+        bool operator==(const Iterator& other) const {
+            return valid == other.valid && (!valid || token.data() == other.token.data());
+        }
+        bool operator!=(const Iterator& other) const { return !(*this == other); }
+    };
+
+private:
+    std::string_view code;
+    std::string_view args;
+    bool binary;
+
+public:
+    CommandView() : binary(false) {}
+
+    CommandView(const uint8_t* data, size_t len) : binary(false) {
+        std::string_view str(reinterpret_cast<const char*>(data), len);
+        size_t split = str.find_first_of(std::string_view("|\0", 2));
+        if (split == std::string_view::npos) {
+            code = str;
+            return;
+        }
+        binary = str[split] == static_cast<char>(BINARY_MARK);
+        code = str.substr(0, split);
+        args = str.substr(split + 1);
+    }
+
+    explicit CommandView(const std::vector<uint8_t>& data) : CommandView(data.data(), data.size()) {}
+
+    std::string_view Code() const { return code; }
+    bool IsBinary() const { return binary; }
+
+    // Raw argument bytes after the separator
+    std::string_view Args() const { return args; }
+
+    Iterator begin() const { return binary ? Iterator() : Iterator(args); }
+    Iterator end() const { return Iterator(); }
+
+    size_t Count() const {
+        if (binary) return 0;
+        size_t n = 0;
+        for (char c : args) n += (c == ';');
+        return n;
+    }
+
+    // i-th text argument; empty view when out of range
+    std::string_view Arg(size_t index) const {
+        for (auto token : *this) {
+            if (index-- == 0) return token;
+        }
+        return {};
+    }
+
+    template<typename T>
+    static bool Parse(std::string_view token, T& out) {
+        if constexpr (std::is_same_v<T, std::string_view>) {
+            out = token;
+            return true;
+        } else if constexpr (std::is_same_v<T, std::string>) {
+            out.assign(token.data(), token.size());
+            return true;
+        } else if constexpr (std::is_same_v<T, bool>) {
+            out = token == "1" || token == "true";
+            return out || token == "0" || token == "false";
+        } else if constexpr (std::is_integral_v<T>) {
+            auto res = std::from_chars(token.data(), token.data() + token.size(), out);
+            return res.ec == std::errc() && res.ptr == token.data() + token.size();
+        } else if constexpr (std::is_floating_point_v<T>) {
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+            auto res = std::from_chars(token.data(), token.data() + token.size(), out);
+            return res.ec == std::errc() && res.ptr == token.data() + token.size();
+#else
+            char buf[64];
+            if (token.empty() || token.size() >= sizeof(buf)) return false;
+            std::memcpy(buf, token.data(), token.size());
+            buf[token.size()] = '\0';
+            char* end = nullptr;
+            out = static_cast<T>(std::strtod(buf, &end));
+            return end == buf + token.size();
+#endif
+        } else {
+            static_assert(Detail::DependentFalse<T>::value, "Unsupported text argument type");
+        }
+    }
+
+    template<typename T>
+    bool Get(size_t index, T& out) const {
+        return !binary && Parse(Arg(index), out);
+    }
+
+    template<typename T>
+    T GetOr(size_t index, T default_val) const {
+        T out;
+        return Get(index, out) ? out : default_val;
+    }
+
+    // Typed binary decode of the arguments (see MagicWords::EncodeBinary)
+    template<typename... Args>
+    bool DecodeBinary(Args&... out) const {
+        if (!binary) return false;
+        ByteReader reader(reinterpret_cast<const uint8_t*>(args.data()), args.size());
+        return (Detail::ReadValue(reader, out) && ...) && reader.Remaining() == 0;
+    }
+};
+
 // Magic words helper for game commands
 class MagicWords {
 public:
@@ -92,24 +646,44 @@ public:
     static const std::string GAME_END;
 
 private:
-    static std::map<std::string, std::string> customWords;
+    // Sorted by word so lookups binary-search a string_view without
+    // allocating; registration is rare, lookups happen per message
+    using CustomWord = std::pair<std::string, std::string>;
+    static std::vector<CustomWord> customWords;
+
+    static std::vector<CustomWord>::iterator FindSlot(std::string_view word) {
+        return std::lower_bound(customWords.begin(), customWords.end(), word,
+                                [](const CustomWord& w, std::string_view key) { return w.first < key; });
+    }
 
 public:
     static void Register(const std::string& word, const std::string& code) {
         if (code.length() != 2) {
             throw std::invalid_argument("Magic word codes must be exactly 2 characters");
         }
-        customWords[word] = code;
+        auto it = FindSlot(word);
+        if (it != customWords.end() && it->first == word) {
+            it->second = code;
+        } else {
+            customWords.insert(it, CustomWord(word, code));
+        }
+    }
+
+    // Registered code for `word`, or `word` itself. The view points into the
+    // table or into `word` and is valid until the next Register().
+    static std::string_view Lookup(std::string_view word) {
+        if (customWords.empty()) return word;
+        auto it = FindSlot(word);
+        return (it != customWords.end() && it->first == word) ? std::string_view(it->second) : word;
     }
 
     static std::string Get(const std::string& word) {
-        auto it = customWords.find(word);
-        return (it != customWords.end()) ? it->second : word;
+        return std::string(Lookup(word));
     }
 
     template<typename... Args>
     static std::vector<uint8_t> Encode(const std::string& word, Args... args) {
-        std::string code = Get(word);
+        std::string_view code = Lookup(word);
         std::vector<uint8_t> data(code.begin(), code.end());
         data.push_back('|');
         
@@ -118,6 +692,59 @@ public:
         return data;
     }
 
+    // Binary form: code, BINARY_MARK, then each argument in its compile-time
+    // wire format (zigzag/varint integers, raw IEEE or Fixed<> floats,
+    // length-prefixed strings).
+    static constexpr uint8_t BINARY_MARK = CommandView::BINARY_MARK;
+
+    template<typename... Args>
+    static std::vector<uint8_t> EncodeBinary(const std::string& word, const Args&... args) {
+        std::string_view code = Lookup(word);
+        std::vector<uint8_t> data;
+        data.reserve(code.size() + 1 + sizeof...(Args) * 4);
+        data.insert(data.end(), code.begin(), code.end());
+        data.push_back(BINARY_MARK);
+
+        ByteWriter writer(data);
+        (Detail::WriteValue(writer, args), ...);
+        return data;
+    }
+
+    // Typed decode of EncodeBinary output. `code` and string_view arguments
+    // point into `data`. Fails on text payloads, truncation or trailing bytes.
+    template<typename... Args>
+    static bool DecodeBinary(const uint8_t* data, size_t len, std::string_view& code, Args&... args) {
+        const uint8_t* mark = static_cast<const uint8_t*>(std::memchr(data, BINARY_MARK, len));
+        if (!mark) return false;
+
+        code = std::string_view(reinterpret_cast<const char*>(data), mark - data);
+        ByteReader reader(mark + 1, len - (mark - data) - 1);
+        return (Detail::ReadValue(reader, args) && ...) && reader.Remaining() == 0;
+    }
+
+    template<typename... Args>
+    static bool DecodeBinary(const std::vector<uint8_t>& data, std::string_view& code, Args&... args) {
+        return DecodeBinary(data.data(), data.size(), code, args...);
+    }
+
+    static bool IsBinary(const std::vector<uint8_t>& data) {
+        for (uint8_t b : data) {
+            if (b == BINARY_MARK) return true;
+            if (b == '|') return false;
+        }
+        return false;
+    }
+
+    // Allocation-free decode; the view borrows `data`
+    static CommandView DecodeView(const uint8_t* data, size_t len) {
+        return CommandView(data, len);
+    }
+
+    static CommandView DecodeView(const std::vector<uint8_t>& data) {
+        return CommandView(data);
+    }
+
+    // Owning decode kept for compatibility; prefer DecodeView
     static std::pair<std::string, std::vector<std::string>> Decode(const std::vector<uint8_t>& data) {
         std::string str(data.begin(), data.end());
         size_t pipe = str.find('|');
@@ -125,20 +752,14 @@ public:
         if (pipe == std::string::npos) {
             return {str, {}};
         }
-        
-        std::string code = str.substr(0, pipe);
-        std::string args_str = str.substr(pipe + 1);
+
+        CommandView view(data);
         std::vector<std::string> args;
-        
-        size_t pos = 0;
-        while (pos < args_str.length()) {
-            size_t semi = args_str.find(';', pos);
-            if (semi == std::string::npos) break;
-            args.push_back(args_str.substr(pos, semi - pos));
-            pos = semi + 1;
+        for (auto token : view) {
+            args.emplace_back(token);
         }
-        
-        return {code, args};
+
+        return {str.substr(0, pipe), args};
     }
 
 private:
@@ -179,97 +800,473 @@ const std::string MagicWords::LEAVE_ROOM = "LR";
 const std::string MagicWords::ROOM_READY = "RR";
 const std::string MagicWords::GAME_START = "GS";
 const std::string MagicWords::GAME_END = "GE";
-std::map<std::string, std::string> MagicWords::customWords;
-
-// Packet class
-class Packet {
-public:
-    uint8_t flag;
-    uint8_t version;
-    uint16_t seq;
-    std::vector<uint8_t> requirements;
-    std::vector<uint8_t> payload;
-
-    Packet() : flag(0), version(Protocol::VERSION), seq(0) {}
-    
-    Packet(Flag f, uint16_t sequence) 
-        : flag(static_cast<uint8_t>(f)), version(Protocol::VERSION), seq(sequence) {}
-    
-    Packet(Flag f, uint16_t sequence, const std::vector<uint8_t>& req, const std::vector<uint8_t>& data)
-        : flag(static_cast<uint8_t>(f)), version(Protocol::VERSION), seq(sequence), 
-          requirements(req), payload(data) {}
-
-    std::vector<uint8_t> Serialize() const {
-        uint16_t payload_len = static_cast<uint16_t>(payload.size());
-        uint16_t req_len = static_cast<uint16_t>(requirements.size());
+std::vector<MagicWords::CustomWord> MagicWords::customWords;
 
-        std::vector<uint8_t> buffer;
-        buffer.reserve(8 + req_len + payload_len);
+// Compile-time code -> opcode table. Opcodes are small integers starting at
+// `base`, so several tables can share one dispatcher without overlapping.
+template<size_t N>
+struct OpcodeTable {
+    static constexpr uint8_t INVALID = 0xFF;
 
-        buffer.push_back(flag);
-        buffer.push_back(version);
-        buffer.push_back((seq >> 8) & 0xFF);
-        buffer.push_back(seq & 0xFF);
-        buffer.push_back((payload_len >> 8) & 0xFF);
-        buffer.push_back(payload_len & 0xFF);
-        buffer.push_back((req_len >> 8) & 0xFF);
-        buffer.push_back(req_len & 0xFF);
+    uint8_t base;
+    std::array<std::string_view, N> codes;
 
-        buffer.insert(buffer.end(), requirements.begin(), requirements.end());
-        buffer.insert(buffer.end(), payload.begin(), payload.end());
+    constexpr uint8_t Of(std::string_view code) const {
+        for (size_t i = 0; i < N; i++) {
+            if (codes[i] == code) return static_cast<uint8_t>(base + i);
+        }
+        return INVALID;
+    }
 
-        return buffer;
+    constexpr std::string_view CodeOf(uint8_t opcode) const {
+        return (opcode >= base && opcode < base + N) ? codes[opcode - base] : std::string_view();
     }
 
-    static Packet Deserialize(const std::vector<uint8_t>& data) {
-        if (data.size() < 8) {
-            throw std::runtime_error("Packet too small");
+    constexpr size_t Size() const { return N; }
+    constexpr uint8_t End() const { return static_cast<uint8_t>(base + N); }
+};
+
+namespace Opcode {
+    // Same order and codes as the MagicWords constants
+    constexpr OpcodeTable<25> BUILTIN = {0, {
+        "MV", "ATK", "JMP", "SHT", "INT", "CHT", "SPN", "DTH", "DMG", "HEL",
+        "PKP", "DRP", "USE", "EQP", "CST",
+        "SF", "SD", "EU", "EC", "ED",
+        "JR", "LR", "RR", "GS", "GE"
+    }};
+
+    constexpr uint8_t MOVE = BUILTIN.Of("MV");
+    constexpr uint8_t ATTACK = BUILTIN.Of("ATK");
+    constexpr uint8_t JUMP = BUILTIN.Of("JMP");
+    constexpr uint8_t SHOOT = BUILTIN.Of("SHT");
+    constexpr uint8_t INTERACT = BUILTIN.Of("INT");
+    constexpr uint8_t CHAT = BUILTIN.Of("CHT");
+    constexpr uint8_t SPAWN = BUILTIN.Of("SPN");
+    constexpr uint8_t DEATH = BUILTIN.Of("DTH");
+    constexpr uint8_t DAMAGE = BUILTIN.Of("DMG");
+    constexpr uint8_t HEAL = BUILTIN.Of("HEL");
+    constexpr uint8_t PICKUP = BUILTIN.Of("PKP");
+    constexpr uint8_t DROP = BUILTIN.Of("DRP");
+    constexpr uint8_t USE = BUILTIN.Of("USE");
+    constexpr uint8_t EQUIP = BUILTIN.Of("EQP");
+    constexpr uint8_t CAST = BUILTIN.Of("CST");
+    constexpr uint8_t STATE_FULL = BUILTIN.Of("SF");
+    constexpr uint8_t STATE_DELTA = BUILTIN.Of("SD");
+    constexpr uint8_t ENTITY_UPDATE = BUILTIN.Of("EU");
+    constexpr uint8_t ENTITY_CREATE = BUILTIN.Of("EC");
+    constexpr uint8_t ENTITY_DESTROY = BUILTIN.Of("ED");
+    constexpr uint8_t JOIN_ROOM = BUILTIN.Of("JR");
+    constexpr uint8_t LEAVE_ROOM = BUILTIN.Of("LR");
+    constexpr uint8_t ROOM_READY = BUILTIN.Of("RR");
+    constexpr uint8_t GAME_START = BUILTIN.Of("GS");
+    constexpr uint8_t GAME_END = BUILTIN.Of("GE");
+
+    // First opcode free for game-defined tables
+    constexpr uint8_t FIRST_CUSTOM = BUILTIN.End();
+    constexpr uint8_t INVALID = OpcodeTable<1>::INVALID;
+
+    // Codes of up to 4 characters packed into one integer key
+    constexpr uint32_t PackCode(std::string_view code) {
+        uint32_t key = 0;
+        for (size_t i = 0; i < code.size() && i < 4; i++) {
+            key = (key << 8) | static_cast<uint8_t>(code[i]);
         }
+        return key;
+    }
+}
 
-        Packet pkt;
-        pkt.flag = data[0];
-        pkt.version = data[1];
-        pkt.seq = (data[2] << 8) | data[3];
+// Routes decoded commands to handlers through a flat 256-entry jump table.
+// Codes resolve to opcodes via a fixed open-addressed table keyed by the
+// packed code, so dispatch cost is independent of how many commands exist.
+class CommandDispatcher {
+public:
+    using Handler = std::function<void(const CommandView&, const std::string&, uint16_t)>;
 
-        uint16_t payload_len = (data[4] << 8) | data[5];
-        uint16_t req_len = (data[6] << 8) | data[7];
+private:
+    static constexpr size_t LOOKUP_SLOTS = 512;  // Power of two, > 2x max opcodes
 
-        if (data.size() < 8 + req_len + payload_len) {
-            throw std::runtime_error("Packet data incomplete");
-        }
+    struct LookupSlot {
+        uint32_t key = 0;
+        uint8_t opcode = Opcode::INVALID;
+    };
 
-        pkt.requirements.assign(data.begin() + 8, data.begin() + 8 + req_len);
-        pkt.payload.assign(data.begin() + 8 + req_len, data.begin() + 8 + req_len + payload_len);
+    std::array<Handler, 256> handlers;
+    std::array<LookupSlot, LOOKUP_SLOTS> lookup;
+    Handler fallback;
+    unsigned next_custom;
 
-        return pkt;
+    static size_t SlotOf(uint32_t key) {
+        return static_cast<size_t>((key * 0x9E3779B1u) >> 23) & (LOOKUP_SLOTS - 1);
     }
 
-    static Packet MakeConn(uint16_t seq, const std::vector<uint8_t>& client_pubkey) {
-        return Packet(Flag::CONN, seq, client_pubkey, {});
+    static uint32_t KeyOf(std::string_view code) {
+        if (code.empty() || code.size() > 4) {
+            throw std::invalid_argument("Dispatcher codes must be 1-4 characters");
+        }
+        return Opcode::PackCode(code);
     }
 
-    static Packet MakeGive(uint16_t seq, const std::vector<uint8_t>& recipient_key, const std::vector<uint8_t>& data) {
-        return Packet(Flag::GIVE, seq, recipient_key, data);
+public:
+    CommandDispatcher() : next_custom(Opcode::FIRST_CUSTOM) {
+        Register(Opcode::BUILTIN);
     }
 
-    static Packet MakeTake(uint16_t seq, const std::vector<uint8_t>& resource_id = {}) {
-        return Packet(Flag::TAKE, seq, resource_id, {});
+    // Maps a code to a fixed opcode (replacing any previous mapping)
+    void Map(std::string_view code, uint8_t opcode) {
+        if (opcode == Opcode::INVALID) {
+            throw std::invalid_argument("Opcode 255 is reserved");
+        }
+        uint32_t key = KeyOf(code);
+        size_t i = SlotOf(key);
+        for (size_t probes = 0;; probes++, i = (i + 1) & (LOOKUP_SLOTS - 1)) {
+            if (probes == LOOKUP_SLOTS) {
+                throw std::runtime_error("Dispatcher lookup table is full");
+            }
+            if (lookup[i].key == 0 || lookup[i].key == key) break;
+        }
+        lookup[i].key = key;
+        lookup[i].opcode = opcode;
+        if (opcode >= next_custom) next_custom = opcode + 1u;
     }
 
-    static Packet MakeSeen(uint16_t seq) {
-        return Packet(Flag::SEEN, seq, {}, {});
+    template<size_t N>
+    void Register(const OpcodeTable<N>& table) {
+        for (size_t i = 0; i < N; i++) {
+            Map(table.codes[i], static_cast<uint8_t>(table.base + i));
+        }
+    }
+
+    uint8_t Lookup(std::string_view code) const {
+        if (code.empty() || code.size() > 4) return Opcode::INVALID;
+        uint32_t key = Opcode::PackCode(code);
+        size_t i = SlotOf(key);
+        for (size_t probes = 0; probes < LOOKUP_SLOTS; probes++, i = (i + 1) & (LOOKUP_SLOTS - 1)) {
+            if (lookup[i].key == key) return lookup[i].opcode;
+            if (lookup[i].key == 0) break;
+        }
+        return Opcode::INVALID;
+    }
+
+    void On(uint8_t opcode, Handler handler) { handlers[opcode] = std::move(handler); }
+
+    // Binds a handler by code; unknown codes get the next free custom opcode
+    uint8_t On(std::string_view code, Handler handler) {
+        uint8_t opcode = Lookup(code);
+        if (opcode == Opcode::INVALID) {
+            if (next_custom >= Opcode::INVALID) {
+                throw std::runtime_error("Out of dispatcher opcodes");
+            }
+            opcode = static_cast<uint8_t>(next_custom);
+            Map(code, opcode);
+        }
+        On(opcode, std::move(handler));
+        return opcode;
+    }
+
+    // Called for commands with no registered handler
+    void SetFallback(Handler handler) { fallback = std::move(handler); }
+
+    bool Dispatch(const CommandView& cmd, const std::string& host = "", uint16_t port = 0) const {
+        uint8_t opcode = Lookup(cmd.Code());
+        if (opcode != Opcode::INVALID && handlers[opcode]) {
+            handlers[opcode](cmd, host, port);
+            return true;
+        }
+        if (fallback) fallback(cmd, host, port);
+        return false;
+    }
+};
+
+// Outcome of Packet::Parse
+enum class ParseStatus : uint8_t {
+    OK = 0,
+    TOO_SMALL,    // Shorter than the 8-byte header
+    INCOMPLETE,   // Header declares more bytes than were received
+    BAD_VERSION,  // version != Protocol::VERSION
+    BAD_FLAG      // flag > Flag::PONG
+};
+
+// Non-owning view over a serialized packet; valid while the source buffer lives
+struct PacketView {
+    uint8_t flag = 0;
+    uint8_t version = 0;
+    uint16_t seq = 0;
+    const uint8_t* requirements = nullptr;
+    uint16_t requirements_len = 0;
+    const uint8_t* payload = nullptr;
+    uint16_t payload_len = 0;
+};
+
+// ============================================================================
+// Schema-declared binary messages
+// ============================================================================
+
+// One serialized member; `since` is the schema version that introduced it
+template<typename C, typename T>
+struct Field {
+    T C::* member;
+    uint8_t since;
+
+    constexpr Field(T C::* m, uint8_t introduced = 1) : member(m), since(introduced) {}
+};
+
+// Specialize (or use HERO_MESSAGE) with ID, VERSION and a constexpr Fields()
+// tuple. Field order is the wire order; new fields go at the end with a
+// higher `since` so older peers keep decoding.
+template<typename T>
+struct MessageSchema;
+
+#define HERO_MESSAGE(Type, Id, Version, ...)                                    \
+    template<> struct HERO::MessageSchema<Type> {                               \
+        static constexpr uint16_t ID = Id;                                      \
+        static constexpr uint8_t VERSION = Version;                             \
+        static constexpr auto Fields() {                                        \
+            using namespace HERO;                                               \
+            return std::make_tuple(__VA_ARGS__);                                \
+        }                                                                       \
+    };
+
+namespace Messages {
+    // First payload byte; never a valid MagicWords code character
+    constexpr uint8_t MARK = 0x01;
+
+    template<typename T, typename = void>
+    struct HasSchema : std::false_type {};
+
+    template<typename T>
+    struct HasSchema<T, std::void_t<decltype(MessageSchema<T>::ID)>> : std::true_type {};
+
+    template<typename T> struct IsVector : std::false_type {};
+    template<typename T, typename A> struct IsVector<std::vector<T, A>> : std::true_type {};
+
+    template<typename T> void WriteBody(ByteWriter& w, const T& msg);
+    template<typename T> bool ReadBody(ByteReader& r, T& msg, uint8_t version);
+
+    template<typename T>
+    void WriteField(ByteWriter& w, const T& v) {
+        if constexpr (HasSchema<T>::value) {
+            WriteBody(w, v);
+        } else if constexpr (IsVector<T>::value) {
+            w.WriteVarUInt(v.size());
+            for (const auto& item : v) WriteField(w, item);
+        } else {
+            Detail::WriteValue(w, v);
+        }
+    }
+
+    template<typename T>
+    bool ReadField(ByteReader& r, T& v) {
+        if constexpr (HasSchema<T>::value) {
+            return ReadBody(r, v, MessageSchema<T>::VERSION);
+        } else if constexpr (IsVector<T>::value) {
+            uint64_t count;
+            if (!r.ReadVarUInt(count) || count > r.Remaining()) return false;
+            v.resize(static_cast<size_t>(count));
+            for (auto& item : v) {
+                if (!ReadField(r, item)) return false;
+            }
+            return true;
+        } else {
+            return Detail::ReadValue(r, v);
+        }
+    }
+
+    template<typename T>
+    void WriteBody(ByteWriter& w, const T& msg) {
+        std::apply([&](const auto&... field) { (WriteField(w, msg.*(field.member)), ...); },
+                   MessageSchema<T>::Fields());
+    }
+
+    // Fields newer than the sender's version keep their default values
+    template<typename T>
+    bool ReadBody(ByteReader& r, T& msg, uint8_t version) {
+        return std::apply([&](const auto&... field) {
+            return ((field.since > version || ReadField(r, msg.*(field.member))) && ...);
+        }, MessageSchema<T>::Fields());
+    }
+
+    // Appends [MARK][id][version][body length][body]
+    template<typename T>
+    void Write(const T& msg, std::vector<uint8_t>& out) {
+        static_assert(HasSchema<T>::value, "Type has no MessageSchema");
+        std::vector<uint8_t> body;
+        ByteWriter body_writer(body);
+        WriteBody(body_writer, msg);
+
+        ByteWriter w(out);
+        w.WriteU8(MARK);
+        w.WriteVarUInt(MessageSchema<T>::ID);
+        w.WriteU8(MessageSchema<T>::VERSION);
+        w.WriteVarUInt(body.size());
+        w.WriteBytes(body.data(), body.size());
+    }
+
+    template<typename T>
+    std::vector<uint8_t> Encode(const T& msg) {
+        std::vector<uint8_t> out;
+        Write(msg, out);
+        return out;
+    }
+
+    // Reads the message id without decoding the body
+    inline bool PeekId(const uint8_t* data, size_t len, uint16_t& id) {
+        ByteReader r(data, len);
+        uint8_t mark;
+        uint64_t raw;
+        if (!r.ReadU8(mark) || mark != MARK || !r.ReadVarUInt(raw) || raw > 0xFFFF) return false;
+        id = static_cast<uint16_t>(raw);
+        return true;
+    }
+
+    inline bool PeekId(const std::vector<uint8_t>& data, uint16_t& id) {
+        return PeekId(data.data(), data.size(), id);
+    }
+
+    template<typename T>
+    bool Is(const std::vector<uint8_t>& data) {
+        uint16_t id;
+        return PeekId(data, id) && id == MessageSchema<T>::ID;
+    }
+
+    // Bounds-checked decode. Fails on a different id, a newer-than-known
+    // version with a shorter body, or truncation; extra trailing fields
+    // from newer senders are skipped.
+    template<typename T>
+    bool Read(const uint8_t* data, size_t len, T& out) {
+        static_assert(HasSchema<T>::value, "Type has no MessageSchema");
+        ByteReader r(data, len);
+        uint8_t mark, version;
+        uint64_t id, body_len;
+        const uint8_t* body;
+
+        if (!r.ReadU8(mark) || mark != MARK) return false;
+        if (!r.ReadVarUInt(id) || id != MessageSchema<T>::ID) return false;
+        if (!r.ReadU8(version) || !r.ReadVarUInt(body_len)) return false;
+        if (!r.ReadBytes(body, static_cast<size_t>(body_len))) return false;
+
+        ByteReader body_reader(body, static_cast<size_t>(body_len));
+        return ReadBody(body_reader, out, version) && body_reader.Ok();
+    }
+
+    template<typename T>
+    bool Read(const std::vector<uint8_t>& data, T& out) {
+        return Read(data.data(), data.size(), out);
+    }
+}
+
+// Packet class
+class Packet {
+public:
+    uint8_t flag;
+    uint8_t version;
+    uint16_t seq;
+    std::vector<uint8_t> requirements;
+    std::vector<uint8_t> payload;
+
+    Packet() : flag(0), version(Protocol::VERSION), seq(0) {}
+    
+    Packet(Flag f, uint16_t sequence) 
+        : flag(static_cast<uint8_t>(f)), version(Protocol::VERSION), seq(sequence) {}
+    
+    Packet(Flag f, uint16_t sequence, const std::vector<uint8_t>& req, const std::vector<uint8_t>& data)
+        : flag(static_cast<uint8_t>(f)), version(Protocol::VERSION), seq(sequence), 
+          requirements(req), payload(data) {}
+
+    explicit Packet(const PacketView& view)
+        : flag(view.flag), version(view.version), seq(view.seq),
+          requirements(view.requirements, view.requirements + view.requirements_len),
+          payload(view.payload, view.payload + view.payload_len) {}
+
+    std::vector<uint8_t> Serialize() const {
+        uint16_t payload_len = static_cast<uint16_t>(payload.size());
+        uint16_t req_len = static_cast<uint16_t>(requirements.size());
+
+        std::vector<uint8_t> buffer;
+        buffer.reserve(8 + req_len + payload_len);
+
+        buffer.push_back(flag);
+        buffer.push_back(version);
+        buffer.push_back((seq >> 8) & 0xFF);
+        buffer.push_back(seq & 0xFF);
+        buffer.push_back((payload_len >> 8) & 0xFF);
+        buffer.push_back(payload_len & 0xFF);
+        buffer.push_back((req_len >> 8) & 0xFF);
+        buffer.push_back(req_len & 0xFF);
+
+        buffer.insert(buffer.end(), requirements.begin(), requirements.end());
+        buffer.insert(buffer.end(), payload.begin(), payload.end());
+
+        return buffer;
+    }
+
+    // Exception-free parse into a view over `data`. Structural errors leave
+    // `out` partially filled; BAD_VERSION/BAD_FLAG leave it complete.
+    static ParseStatus Parse(const uint8_t* data, size_t len, PacketView& out) noexcept {
+        if (len < static_cast<size_t>(Protocol::HEADER_SIZE)) {
+            return ParseStatus::TOO_SMALL;
+        }
+
+        out.flag = data[0];
+        out.version = data[1];
+        out.seq = static_cast<uint16_t>((data[2] << 8) | data[3]);
+        out.payload_len = static_cast<uint16_t>((data[4] << 8) | data[5]);
+        out.requirements_len = static_cast<uint16_t>((data[6] << 8) | data[7]);
+
+        if (len < static_cast<size_t>(Protocol::HEADER_SIZE) + out.requirements_len + out.payload_len) {
+            return ParseStatus::INCOMPLETE;
+        }
+
+        out.requirements = data + Protocol::HEADER_SIZE;
+        out.payload = out.requirements + out.requirements_len;
+
+        if (out.version != Protocol::VERSION) return ParseStatus::BAD_VERSION;
+        if (out.flag > static_cast<uint8_t>(Flag::PONG)) return ParseStatus::BAD_FLAG;
+        return ParseStatus::OK;
+    }
+
+    static Packet Deserialize(const std::vector<uint8_t>& data) {
+        PacketView view;
+        ParseStatus status = Parse(data.data(), data.size(), view);
+
+        if (status == ParseStatus::TOO_SMALL) {
+            throw std::runtime_error("Packet too small");
+        }
+        if (status == ParseStatus::INCOMPLETE) {
+            throw std::runtime_error("Packet data incomplete");
+        }
+
+        return Packet(view);
+    }
+
+    // A CONN without a valid cookie (clients send zeros) asks for one; a
+    // CONN carrying the server's cookie in its payload completes the handshake.
+    static Packet MakeConn(uint16_t seq, const std::vector<uint8_t>& client_pubkey,
+                           const std::vector<uint8_t>& cookie = {}) {
+        return Packet(Flag::CONN, seq, client_pubkey, cookie);
+    }
+
+    static Packet MakeGive(uint16_t seq, const std::vector<uint8_t>& recipient_key, const std::vector<uint8_t>& data) {
+        return Packet(Flag::GIVE, seq, recipient_key, data);
+    }
+
+    static Packet MakeTake(uint16_t seq, const std::vector<uint8_t>& resource_id = {}) {
+        return Packet(Flag::TAKE, seq, resource_id, {});
+    }
+
+    static Packet MakeSeen(uint16_t seq) {
+        return Packet(Flag::SEEN, seq, {}, {});
     }
 
     static Packet MakeStop(uint16_t seq) {
         return Packet(Flag::STOP, seq, {}, {});
     }
 
-    static Packet MakePing(uint16_t seq) {
-        return Packet(Flag::PING, seq, {}, {});
+    static Packet MakePing(uint16_t seq, const std::vector<uint8_t>& sync = {}) {
+        return Packet(Flag::PING, seq, {}, sync);
     }
 
-    static Packet MakePong(uint16_t seq) {
-        return Packet(Flag::PONG, seq, {}, {});
+    static Packet MakePong(uint16_t seq, const std::vector<uint8_t>& sync = {}) {
+        return Packet(Flag::PONG, seq, {}, sync);
     }
 
     bool IsValid() const {
@@ -286,7 +1283,7 @@ private:
         std::map<uint16_t, std::vector<uint8_t>> fragments;
         std::chrono::steady_clock::time_point last_update;
 
-        FragmentedMessage(uint16_t id, uint16_t total) 
+        FragmentedMessage(uint16_t id = 0, uint16_t total = 0) 
             : msg_id(id), total_fragments(total), last_update(std::chrono::steady_clock::now()) {}
 
         bool IsComplete() const {
@@ -341,7 +1338,15 @@ public:
     }
 
     std::tuple<bool, std::vector<uint8_t>, Flag> AddFragment(const Packet& pkt) {
-        if (pkt.flag != static_cast<uint8_t>(Flag::FRAG) || pkt.payload.size() < Protocol::FRAGMENT_HEADER_SIZE) {
+        PacketView view;
+        view.flag = pkt.flag;
+        view.payload = pkt.payload.data();
+        view.payload_len = static_cast<uint16_t>(pkt.payload.size());
+        return AddFragment(view);
+    }
+
+    std::tuple<bool, std::vector<uint8_t>, Flag> AddFragment(const PacketView& pkt) {
+        if (pkt.flag != static_cast<uint8_t>(Flag::FRAG) || pkt.payload_len < Protocol::FRAGMENT_HEADER_SIZE) {
             return {false, {}, Flag::GIVE};
         }
 
@@ -354,7 +1359,7 @@ public:
             messages.emplace(msg_id, FragmentedMessage(msg_id, total_frags));
         }
 
-        std::vector<uint8_t> fragment_data(pkt.payload.begin() + 7, pkt.payload.end());
+        std::vector<uint8_t> fragment_data(pkt.payload + 7, pkt.payload + pkt.payload_len);
         messages[msg_id].fragments[frag_num] = fragment_data;
         messages[msg_id].last_update = std::chrono::steady_clock::now();
 
@@ -384,11 +1389,48 @@ public:
     }
 };
 
+// Numeric UDP endpoint (IPv4 address in host byte order)
+struct Endpoint {
+    uint32_t addr;
+    uint16_t port;
+
+    Endpoint() : addr(0), port(0) {}
+    Endpoint(uint32_t address, uint16_t p) : addr(address), port(p) {}
+
+    static Endpoint FromString(const std::string& host, uint16_t port) {
+        in_addr a = {};
+        inet_pton(AF_INET, host.c_str(), &a);
+        return Endpoint(ntohl(a.s_addr), port);
+    }
+
+    std::string Host() const {
+        in_addr a = {};
+        a.s_addr = htonl(addr);
+        char ip_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &a, ip_str, sizeof(ip_str));
+        return ip_str;
+    }
+
+    uint64_t Key() const { return (static_cast<uint64_t>(addr) << 16) | port; }
+
+    bool operator==(const Endpoint& other) const {
+        return addr == other.addr && port == other.port;
+    }
+};
+
+// Kernel-side filtering counters. `kernel_drops` is the socket's total drop
+// count: filter rejects plus any receive-buffer overflows.
+struct SocketFilterStats {
+    bool attached = false;
+    uint64_t kernel_drops = 0;
+};
+
 // Socket wrapper
 class HeroSocket {
 private:
     SOCKET sock;
     bool initialized;
+    bool filter_attached;
 
 #ifdef _WIN32
     static bool wsa_initialized;
@@ -396,7 +1438,7 @@ private:
 #endif
 
 public:
-    HeroSocket() : sock(INVALID_SOCKET), initialized(false) {
+    HeroSocket() : sock(INVALID_SOCKET), initialized(false), filter_attached(false) {
 #ifdef _WIN32
         if (!wsa_initialized) {
             WSADATA wsaData;
@@ -447,30 +1489,120 @@ public:
     }
 
     bool Recv(std::vector<uint8_t>& buffer, std::string& from_host, uint16_t& from_port) {
-        char recv_buffer[Protocol::MAX_PACKET_SIZE];
-        sockaddr_in from_addr = {};
-        socklen_t from_len = sizeof(from_addr);
+        uint8_t recv_buffer[Protocol::MAX_PACKET_SIZE];
+        Endpoint from;
 
-        int received = recvfrom(sock, recv_buffer, sizeof(recv_buffer), 0, 
-                               (sockaddr*)&from_addr, &from_len);
+        int received = RecvFrom(recv_buffer, sizeof(recv_buffer), from);
 
         if (received > 0) {
             buffer.assign(recv_buffer, recv_buffer + received);
-            char ip_str[INET_ADDRSTRLEN];
-            inet_ntop(AF_INET, &from_addr.sin_addr, ip_str, sizeof(ip_str));
-            from_host = ip_str;
-            from_port = ntohs(from_addr.sin_port);
+            from_host = from.Host();
+            from_port = from.port;
             return true;
         }
 
         return false;
     }
 
+    bool SendTo(const std::vector<uint8_t>& data, const Endpoint& to) {
+        return SendTo(data.data(), data.size(), to);
+    }
+
+    // Allocation-free send/receive on caller-owned buffers
+    bool SendTo(const uint8_t* data, size_t len, const Endpoint& to) {
+        sockaddr_in addr = {};
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(to.port);
+        addr.sin_addr.s_addr = htonl(to.addr);
+
+        int sent = sendto(sock, reinterpret_cast<const char*>(data), static_cast<int>(len), 0,
+                         (sockaddr*)&addr, sizeof(addr));
+        return sent > 0;
+    }
+
+    int RecvFrom(uint8_t* buffer, size_t capacity, Endpoint& from) {
+        sockaddr_in from_addr = {};
+        socklen_t from_len = sizeof(from_addr);
+
+        int received = recvfrom(sock, reinterpret_cast<char*>(buffer), static_cast<int>(capacity), 0,
+                               (sockaddr*)&from_addr, &from_len);
+
+        if (received > 0) {
+            from.addr = ntohl(from_addr.sin_addr.s_addr);
+            from.port = ntohs(from_addr.sin_port);
+        }
+        return received;
+    }
+
     void Close() {
         if (sock != INVALID_SOCKET) {
             closesocket(sock);
             sock = INVALID_SOCKET;
+            filter_attached = false;
+        }
+    }
+
+    // Attaches a classic BPF program that drops datagrams failing the same
+    // checks as Packet::Deserialize/IsValid in the kernel. Linux only;
+    // returns false elsewhere or if the kernel refuses the program.
+    bool AttachPacketFilter() {
+#ifdef __linux__
+        // A UDP socket filter sees the 8-byte UDP header first, so the HERO
+        // header starts at offset 8.
+        const uint32_t udp = 8;
+        sock_filter code[] = {
+            BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+            BPF_JUMP(BPF_JMP | BPF_JGE | BPF_K, udp + Protocol::HEADER_SIZE, 0, 12),
+            BPF_STMT(BPF_LD | BPF_B | BPF_ABS, udp + 1),
+            BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, Protocol::VERSION, 0, 10),
+            BPF_STMT(BPF_LD | BPF_B | BPF_ABS, udp + 0),
+            BPF_JUMP(BPF_JMP | BPF_JGT | BPF_K, static_cast<uint32_t>(Flag::PONG), 8, 0),
+            BPF_STMT(BPF_LD | BPF_H | BPF_ABS, udp + 4),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_H | BPF_ABS, udp + 6),
+            BPF_STMT(BPF_ALU | BPF_ADD | BPF_X, 0),
+            BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, udp + Protocol::HEADER_SIZE),
+            BPF_STMT(BPF_MISC | BPF_TAX, 0),
+            BPF_STMT(BPF_LD | BPF_W | BPF_LEN, 0),
+            BPF_JUMP(BPF_JMP | BPF_JGE | BPF_X, 0, 1, 0),
+            BPF_STMT(BPF_RET | BPF_K, 0),
+            BPF_STMT(BPF_RET | BPF_K, 0xFFFFFFFF),
+        };
+        sock_fprog prog = {};
+        prog.len = sizeof(code) / sizeof(code[0]);
+        prog.filter = code;
+
+        if (setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog)) != 0) {
+            return false;
+        }
+        filter_attached = true;
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void DetachPacketFilter() {
+#ifdef __linux__
+        if (filter_attached) {
+            int dummy = 0;
+            setsockopt(sock, SOL_SOCKET, SO_DETACH_FILTER, &dummy, sizeof(dummy));
+            filter_attached = false;
+        }
+#endif
+    }
+
+    SocketFilterStats GetFilterStats() const {
+        SocketFilterStats stats;
+        stats.attached = filter_attached;
+#if defined(__linux__) && defined(SO_MEMINFO)
+        uint32_t meminfo[SK_MEMINFO_VARS] = {};
+        socklen_t len = sizeof(meminfo);
+        if (getsockopt(sock, SOL_SOCKET, SO_MEMINFO, meminfo, &len) == 0) {
+            stats.kernel_drops = meminfo[SK_MEMINFO_DROPS];
         }
+#endif
+        return stats;
     }
 
 private:
@@ -490,157 +1622,773 @@ bool HeroSocket::wsa_initialized = false;
 int HeroSocket::wsa_ref_count = 0;
 #endif
 
-// Client class
-class HeroClient {
-private:
-    HeroSocket socket;
-    uint16_t seq_num;
-    std::string server_host;
-    uint16_t server_port;
-    bool connected;
-    FragmentManager fragment_mgr;
-    std::chrono::steady_clock::time_point last_ping;
-    int ping_ms;
+namespace Detail {
+    inline uint64_t Rotl64(uint64_t x, int b) { return (x << b) | (x >> (64 - b)); }
 
-public:
-    HeroClient() : seq_num(0), server_port(0), connected(false), ping_ms(0) {
-        last_ping = std::chrono::steady_clock::now();
+    inline void PutU32(uint8_t* out, uint32_t v) {
+        for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(v >> (24 - 8 * i));
     }
 
-    bool Connect(const std::string& host, uint16_t port, const std::vector<uint8_t>& pubkey = {1, 2, 3, 4}) {
-        server_host = host;
-        server_port = port;
+    inline void PutU64(uint8_t* out, uint64_t v) {
+        for (int i = 0; i < 8; i++) out[i] = static_cast<uint8_t>(v >> (56 - 8 * i));
+    }
 
-        auto conn_pkt = Packet::MakeConn(seq_num++, pubkey);
-        auto data = conn_pkt.Serialize();
+    inline uint32_t GetU32(const uint8_t* in) {
+        uint32_t v = 0;
+        for (int i = 0; i < 4; i++) v = (v << 8) | in[i];
+        return v;
+    }
 
-        if (!socket.Send(data, server_host, server_port)) {
-            return false;
-        }
+    inline uint64_t GetU64(const uint8_t* in) {
+        uint64_t v = 0;
+        for (int i = 0; i < 8; i++) v = (v << 8) | in[i];
+        return v;
+    }
 
-        auto start = std::chrono::steady_clock::now();
-        while (std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now() - start).count() < Protocol::DEFAULT_TIMEOUT_MS) {
-            
-            std::vector<uint8_t> buffer;
-            std::string from_host;
-            uint16_t from_port;
-
-            if (socket.Recv(buffer, from_host, from_port)) {
-                try {
-                    auto pkt = Packet::Deserialize(buffer);
-                    if (pkt.flag == static_cast<uint8_t>(Flag::SEEN)) {
-                        connected = true;
-                        last_ping = std::chrono::steady_clock::now();
-                        return true;
-                    }
-                } catch (...) {}
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    // SipHash-2-4: short-input keyed MAC, cheap enough to run per datagram
+    inline uint64_t SipHash24(uint64_t k0, uint64_t k1, const uint8_t* data, size_t len) {
+        uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+        uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+        uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+        uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+        auto round = [&]() {
+            v0 += v1; v1 = Rotl64(v1, 13); v1 ^= v0; v0 = Rotl64(v0, 32);
+            v2 += v3; v3 = Rotl64(v3, 16); v3 ^= v2;
+            v0 += v3; v3 = Rotl64(v3, 21); v3 ^= v0;
+            v2 += v1; v1 = Rotl64(v1, 17); v1 ^= v2; v2 = Rotl64(v2, 32);
+        };
+
+        size_t full = len & ~static_cast<size_t>(7);
+        for (size_t i = 0; i < full; i += 8) {
+            uint64_t m = 0;
+            for (int b = 0; b < 8; b++) m |= static_cast<uint64_t>(data[i + b]) << (8 * b);
+            v3 ^= m; round(); round(); v0 ^= m;
         }
 
-        return false;
+        uint64_t last = static_cast<uint64_t>(len & 0xFF) << 56;
+        for (size_t b = 0; b < (len & 7); b++) last |= static_cast<uint64_t>(data[full + b]) << (8 * b);
+        v3 ^= last; round(); round(); v0 ^= last;
+
+        v2 ^= 0xFF;
+        round(); round(); round(); round();
+        return v0 ^ v1 ^ v2 ^ v3;
     }
+}
 
-    bool Send(const std::vector<uint8_t>& data, const std::vector<uint8_t>& recipient_key = {}) {
-        if (!connected) return false;
+// Stateless CONN cookies: MAC(secret, source endpoint, time slot). The server
+// keeps no per-attempt state until a client echoes a valid cookie back.
+class ConnCookies {
+private:
+    uint64_t k0, k1;
+    std::chrono::steady_clock::time_point epoch;
 
-        auto pkt = Packet::MakeGive(seq_num++, recipient_key, data);
-        return socket.Send(pkt.Serialize(), server_host, server_port);
+    uint32_t CurrentSlot() const {
+        auto elapsed = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+        return static_cast<uint32_t>(elapsed / Protocol::COOKIE_SLOT_SECONDS);
     }
 
-    bool Send(const std::string& text, const std::vector<uint8_t>& recipient_key = {}) {
-        std::vector<uint8_t> data(text.begin(), text.end());
-        return Send(data, recipient_key);
+    uint64_t Mac(const Endpoint& ep, uint32_t slot) const {
+        uint8_t msg[10] = {
+            static_cast<uint8_t>(ep.addr >> 24), static_cast<uint8_t>(ep.addr >> 16),
+            static_cast<uint8_t>(ep.addr >> 8), static_cast<uint8_t>(ep.addr),
+            static_cast<uint8_t>(ep.port >> 8), static_cast<uint8_t>(ep.port),
+            static_cast<uint8_t>(slot >> 24), static_cast<uint8_t>(slot >> 16),
+            static_cast<uint8_t>(slot >> 8), static_cast<uint8_t>(slot)
+        };
+        return Detail::SipHash24(k0, k1, msg, sizeof(msg));
     }
 
-    template<typename... Args>
-    bool SendCommand(const std::string& command, Args... args) {
-        auto data = MagicWords::Encode(command, args...);
-        return Send(data);
+public:
+    ConnCookies() : epoch(std::chrono::steady_clock::now()) {
+        Rekey();
     }
 
-    bool Ping() {
-        if (!connected) return false;
+    // Invalidates every outstanding cookie
+    void Rekey() {
+        std::random_device rd;
+        k0 = (static_cast<uint64_t>(rd()) << 32) | rd();
+        k1 = (static_cast<uint64_t>(rd()) << 32) | rd();
+    }
 
-        auto ping_start = std::chrono::steady_clock::now();
-        auto pkt = Packet::MakePing(seq_num++);
+    void Make(const Endpoint& ep, uint8_t* out) const {
+        uint32_t slot = CurrentSlot();
+        uint64_t mac = Mac(ep, slot);
+        for (int i = 0; i < 4; i++) out[i] = static_cast<uint8_t>(slot >> (24 - 8 * i));
+        for (int i = 0; i < 8; i++) out[4 + i] = static_cast<uint8_t>(mac >> (56 - 8 * i));
+    }
 
-        if (!socket.Send(pkt.Serialize(), server_host, server_port)) {
-            return false;
-        }
+    bool Verify(const Endpoint& ep, const uint8_t* cookie, size_t len) const {
+        if (len != static_cast<size_t>(Protocol::COOKIE_SIZE)) return false;
 
-        auto start = std::chrono::steady_clock::now();
-        while (std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now() - start).count() < 1000) {
-            
-            std::vector<uint8_t> buffer;
-            std::string from_host;
-            uint16_t from_port;
-
-            if (socket.Recv(buffer, from_host, from_port)) {
-                try {
-                    auto response = Packet::Deserialize(buffer);
-                    if (response.flag == static_cast<uint8_t>(Flag::PONG)) {
-                        ping_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
-                            std::chrono::steady_clock::now() - ping_start).count();
-                        last_ping = std::chrono::steady_clock::now();
-                        return true;
-                    }
-                } catch (...) {}
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
+        uint32_t slot = (static_cast<uint32_t>(cookie[0]) << 24) | (cookie[1] << 16) |
+                        (cookie[2] << 8) | cookie[3];
+        uint32_t now = CurrentSlot();
+        if (slot > now || now - slot > 1) return false;
 
-        return false;
+        uint64_t mac = 0;
+        for (int i = 0; i < 8; i++) mac = (mac << 8) | cookie[4 + i];
+        return (mac ^ Mac(ep, slot)) == 0;
     }
+};
 
-    void KeepAlive() {
-        auto duration = std::chrono::duration_cast<std::chrono::seconds>(
-            std::chrono::steady_clock::now() - last_ping);
-        if (duration.count() > 5) {
-            Ping();
-        }
-    }
+// Receive-path rate classes (TAKE/SEEN/STOP/PONG are billed as GIVE)
+enum class RateClass : uint8_t {
+    CONN = 0,
+    PING = 1,
+    GIVE = 2,
+    FRAG = 3,
+    COUNT = 4
+};
 
-    bool Receive(Packet& out_packet, int timeout_ms = 100) {
-        auto start = std::chrono::steady_clock::now();
-        
-        while (std::chrono::duration_cast<std::chrono::milliseconds>(
-                std::chrono::steady_clock::now() - start).count() < timeout_ms) {
-            
-            std::vector<uint8_t> buffer;
-            std::string from_host;
-            uint16_t from_port;
-
-            if (socket.Recv(buffer, from_host, from_port)) {
-                try {
-                    auto pkt = Packet::Deserialize(buffer);
-
-                    if (pkt.flag == static_cast<uint8_t>(Flag::FRAG)) {
-                        auto [complete, data, original_flag] = fragment_mgr.AddFragment(pkt);
-                        if (complete) {
-                            out_packet = Packet(original_flag, pkt.seq, {}, data);
-                            auto seen = Packet::MakeSeen(out_packet.seq);
-                            socket.Send(seen.Serialize(), from_host, from_port);
-                            return true;
-                        }
-                        continue;
-                    }
+// Token bucket: `rate` packets per second, up to `burst` at once (rate 0 = unlimited)
+struct RateLimit {
+    float rate;
+    float burst;
 
-                    auto seen_pkt = Packet::MakeSeen(pkt.seq);
-                    socket.Send(seen_pkt.Serialize(), from_host, from_port);
+    RateLimit(float r = 0.0f, float b = 0.0f) : rate(r), burst(b) {}
+};
 
-                    out_packet = pkt;
-                    return true;
-                } catch (...) {}
-            }
-            std::this_thread::sleep_for(std::chrono::milliseconds(1));
-        }
+// Endpoint buckets are always applied. Subnet buckets are opt-in: set
+// `subnet_prefix` (e.g. 24) to also cap the aggregate of every source in
+// that subnet, which also throttles clients sharing a NAT or a LAN.
+struct RateLimitConfig {
+    bool enabled = true;
+    int subnet_prefix = 0;  // 0 = no subnet limit
+    RateLimit endpoint[static_cast<int>(RateClass::COUNT)] = {
+        {4.0f, 8.0f}, {20.0f, 40.0f}, {1000.0f, 2000.0f}, {2000.0f, 4000.0f}
+    };
+    RateLimit subnet[static_cast<int>(RateClass::COUNT)] = {
+        {32.0f, 64.0f}, {200.0f, 400.0f}, {8000.0f, 16000.0f}, {16000.0f, 32000.0f}
+    };
+};
 
-        fragment_mgr.CleanupStale();
-        return false;
-    }
+// Per-endpoint and per-subnet token buckets in fixed, direct-mapped tables.
+// A colliding source takes over the slot with a full bucket, so memory stays
+// bounded under spoofed floods and eviction can only make limits more lenient.
+class RateLimiter {
+private:
+    static const int CLASS_COUNT = static_cast<int>(RateClass::COUNT);
+    static const int ENDPOINT_SLOTS_LOG2 = 12;
+    static const int SUBNET_SLOTS_LOG2 = 10;
+
+    struct Bucket {
+        uint64_t key;
+        int64_t last_us;
+        float tokens[CLASS_COUNT];
+    };
+
+    RateLimitConfig config;
+    std::vector<Bucket> endpoints;
+    std::vector<Bucket> subnets;
+    std::chrono::steady_clock::time_point epoch;
+
+    static size_t Slot(uint64_t key, int bits) {
+        return static_cast<size_t>((key * 0x9E3779B97F4A7C15ULL) >> (64 - bits));
+    }
+
+    static bool Take(Bucket& b, uint64_t key, int64_t now_us, int cls, const RateLimit* limits) {
+        if (limits[cls].rate <= 0.0f) return true;
+
+        if (b.key != key) {
+            b.key = key;
+            b.last_us = now_us;
+            for (int i = 0; i < CLASS_COUNT; i++) b.tokens[i] = limits[i].burst;
+        } else if (now_us > b.last_us) {
+            float dt = (now_us - b.last_us) * 1e-6f;
+            for (int i = 0; i < CLASS_COUNT; i++) {
+                b.tokens[i] = std::min(limits[i].burst, b.tokens[i] + limits[i].rate * dt);
+            }
+            b.last_us = now_us;
+        }
+
+        if (b.tokens[cls] < 1.0f) return false;
+        b.tokens[cls] -= 1.0f;
+        return true;
+    }
+
+public:
+    RateLimiter(const RateLimitConfig& cfg = RateLimitConfig())
+        : config(cfg),
+          endpoints(static_cast<size_t>(1) << ENDPOINT_SLOTS_LOG2, Bucket{~0ULL, 0, {}}),
+          subnets(static_cast<size_t>(1) << SUBNET_SLOTS_LOG2, Bucket{~0ULL, 0, {}}),
+          epoch(std::chrono::steady_clock::now()) {}
+
+    void Configure(const RateLimitConfig& cfg) {
+        config = cfg;
+        for (auto& b : endpoints) b.key = ~0ULL;
+        for (auto& b : subnets) b.key = ~0ULL;
+    }
+
+    const RateLimitConfig& GetConfig() const { return config; }
+
+    static RateClass ClassOf(uint8_t flag) {
+        switch (static_cast<Flag>(flag)) {
+            case Flag::CONN: return RateClass::CONN;
+            case Flag::PING: return RateClass::PING;
+            case Flag::FRAG: return RateClass::FRAG;
+            default:         return RateClass::GIVE;
+        }
+    }
+
+    bool Allow(const Endpoint& from, RateClass cls) {
+        if (!config.enabled) return true;
+
+        int64_t now_us = std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - epoch).count();
+        int c = static_cast<int>(cls);
+
+        if (config.subnet_prefix > 0) {
+            int prefix = std::min(32, config.subnet_prefix);
+            uint64_t subnet_key = from.addr & (~0U << (32 - prefix));
+            if (!Take(subnets[Slot(subnet_key, SUBNET_SLOTS_LOG2)], subnet_key, now_us, c, config.subnet)) {
+                return false;
+            }
+        }
+
+        uint64_t ep_key = from.Key();
+        return Take(endpoints[Slot(ep_key, ENDPOINT_SLOTS_LOG2)], ep_key, now_us, c, config.endpoint);
+    }
+};
+
+// Server-side receive counters
+struct ServerStats {
+    uint64_t received = 0;
+    uint64_t rate_limited[static_cast<int>(RateClass::COUNT)] = {};
+    uint64_t malformed = 0;       // Failed Packet::Parse
+    uint64_t handler_errors = 0;  // Exceptions thrown by the Poll handler
+
+    uint64_t TotalRateLimited() const {
+        uint64_t total = 0;
+        for (auto n : rate_limited) total += n;
+        return total;
+    }
+};
+
+// Smoothed link quality for one peer (RFC 6298 style estimators)
+struct LinkStats {
+    double srtt_us = 0.0;    // Smoothed round-trip time
+    double rttvar_us = 0.0;  // Round-trip variation (jitter)
+    double loss = 0.0;       // Rolling loss rate, 0..1
+    uint64_t samples = 0;
+    uint64_t sent = 0;
+    uint64_t acked = 0;
+    uint64_t lost = 0;
+};
+
+// Measures RTT from the acks that normal traffic already produces: the send
+// time of every tracked seq is remembered locally and matched against the
+// SEEN/PONG that echoes it. Unacked packets count as lost after one RTO.
+class LinkEstimator {
+private:
+    static constexpr int WINDOW = 256;
+    static constexpr int64_t MIN_RTO_US = 100000;
+    static constexpr int64_t MAX_RTO_US = 2000000;
+    static constexpr int64_t EXPIRE_INTERVAL_US = 50000;
+    static constexpr double LOSS_ALPHA = 1.0 / 64.0;
+
+    struct Slot {
+        uint16_t seq;
+        bool pending;
+        int64_t sent_us;
+    };
+
+    std::array<Slot, WINDOW> slots;
+    LinkStats stats;
+    int64_t last_expire_us;
+
+    int64_t Rto() const {
+        if (stats.samples == 0) return 1000000;
+        int64_t rto = static_cast<int64_t>(stats.srtt_us + 4.0 * stats.rttvar_us);
+        return std::max(MIN_RTO_US, std::min(MAX_RTO_US, rto));
+    }
+
+    void RecordLoss() {
+        stats.lost++;
+        stats.loss += (1.0 - stats.loss) * LOSS_ALPHA;
+    }
+
+    void Expire(int64_t now_us) {
+        if (now_us - last_expire_us < EXPIRE_INTERVAL_US) return;
+        last_expire_us = now_us;
+
+        int64_t rto = Rto();
+        for (auto& slot : slots) {
+            if (slot.pending && now_us - slot.sent_us > rto) {
+                slot.pending = false;
+                RecordLoss();
+            }
+        }
+    }
+
+public:
+    LinkEstimator() : slots(), last_expire_us(0) {}
+
+    static int64_t NowMicros() {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    void OnSend(uint16_t seq, int64_t now_us = NowMicros()) {
+        Slot& slot = slots[seq % WINDOW];
+        if (slot.pending) RecordLoss();  // Overwritten before its ack arrived
+        slot.seq = seq;
+        slot.pending = true;
+        slot.sent_us = now_us;
+        stats.sent++;
+        Expire(now_us);
+    }
+
+    void OnAck(uint16_t seq, int64_t now_us = NowMicros()) {
+        Slot& slot = slots[seq % WINDOW];
+        if (slot.pending && slot.seq == seq) {
+            slot.pending = false;
+            double rtt = static_cast<double>(now_us - slot.sent_us);
+
+            if (stats.samples == 0) {
+                stats.srtt_us = rtt;
+                stats.rttvar_us = rtt / 2.0;
+            } else {
+                stats.rttvar_us = 0.75 * stats.rttvar_us + 0.25 * std::abs(stats.srtt_us - rtt);
+                stats.srtt_us = 0.875 * stats.srtt_us + 0.125 * rtt;
+            }
+            stats.samples++;
+            stats.acked++;
+            stats.loss -= stats.loss * LOSS_ALPHA;
+        }
+        Expire(now_us);
+    }
+
+    const LinkStats& GetStats() const { return stats; }
+};
+
+// NTP-style server clock estimate built from PING/PONG timestamps:
+//   offset = ((t1 - t0) + (t2 - t3)) / 2,  delay = (t3 - t0) - (t2 - t1)
+// The lowest-delay samples of a short window are fitted with a line, giving
+// an offset plus a drift rate so the estimate holds between syncs.
+class ClockSync {
+private:
+    static constexpr int WINDOW = 16;
+    static constexpr double MAX_DRIFT = 500e-6;  // 500 ppm
+
+    struct Sample {
+        int64_t local_us;
+        double offset_us;
+        double delay_us;
+    };
+
+    std::array<Sample, WINDOW> samples;
+    int count;
+    int next;
+    double offset_us;
+    double drift;
+    int64_t ref_local_us;
+
+    uint32_t tick;
+    int64_t tick_server_us;
+    uint32_t tick_interval_us;
+
+    void Refit() {
+        double min_delay = samples[0].delay_us;
+        for (int i = 1; i < count; i++) min_delay = std::min(min_delay, samples[i].delay_us);
+        double max_delay = min_delay * 1.5 + 100.0;
+
+        // Least-squares line through the good samples, centred on the newest
+        const Sample& newest = samples[(next + WINDOW - 1) % WINDOW];
+        double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (int i = 0; i < count; i++) {
+            if (samples[i].delay_us > max_delay) continue;
+            double x = static_cast<double>(samples[i].local_us - newest.local_us);
+            double y = samples[i].offset_us;
+            n += 1; sx += x; sy += y; sxx += x * x; sxy += x * y;
+        }
+
+        double slope = 0.0;
+        double denom = n * sxx - sx * sx;
+        if (n >= 3 && denom > 0.0 && (sxx / n - (sx / n) * (sx / n)) > 1e12) {
+            slope = std::max(-MAX_DRIFT, std::min(MAX_DRIFT, (n * sxy - sx * sy) / denom));
+        }
+
+        ref_local_us = newest.local_us;
+        drift = slope;
+        offset_us = (sy - slope * sx) / n;
+    }
+
+public:
+    ClockSync() : samples(), count(0), next(0), offset_us(0.0), drift(0.0), ref_local_us(0),
+                  tick(0), tick_server_us(0), tick_interval_us(0) {}
+
+    // t0/t3: local send/receive, t1/t2: server receive/send (all microseconds)
+    void AddSample(int64_t t0, int64_t t1, int64_t t2, int64_t t3) {
+        double delay = static_cast<double>((t3 - t0) - (t2 - t1));
+        if (delay < 0.0) return;
+
+        Sample& s = samples[next];
+        s.local_us = t3;
+        s.offset_us = ((t1 - t0) + (t2 - t3)) / 2.0;
+        s.delay_us = delay;
+        next = (next + 1) % WINDOW;
+        count = std::min(count + 1, WINDOW);
+        Refit();
+    }
+
+    void SetTick(uint32_t server_tick, int64_t server_us, uint32_t interval_us) {
+        tick = server_tick;
+        tick_server_us = server_us;
+        tick_interval_us = interval_us;
+    }
+
+    bool IsSynced() const { return count > 0; }
+    int SampleCount() const { return count; }
+    double GetOffset() const { return offset_us; }
+    double GetDrift() const { return drift; }
+
+    int64_t ServerTime(int64_t local_us) const {
+        double off = offset_us + drift * static_cast<double>(local_us - ref_local_us);
+        return local_us + static_cast<int64_t>(std::llround(off));
+    }
+
+    bool HasTickRate() const { return tick_interval_us != 0; }
+
+    // Server time at which `server_tick` started (needs the tick rate)
+    int64_t TickTime(uint32_t server_tick) const {
+        return tick_server_us + static_cast<int64_t>(static_cast<int32_t>(server_tick - tick)) * tick_interval_us;
+    }
+
+    double ServerTick(int64_t local_us) const {
+        if (tick_interval_us == 0) return tick;
+        return tick + static_cast<double>(ServerTime(local_us) - tick_server_us) / tick_interval_us;
+    }
+};
+
+// Progress of BeginConnect / BeginPing, advanced by HeroClient::Update
+enum class ConnectState : uint8_t {
+    IDLE,
+    CONNECTING,
+    CONNECTED,
+    FAILED
+};
+
+enum class PingState : uint8_t {
+    IDLE,
+    PENDING,
+    DONE,
+    TIMED_OUT
+};
+
+// Client class
+class HeroClient {
+public:
+    using ConnectCallback = std::function<void(bool connected)>;
+    using PingCallback = std::function<void(bool ok, int ping_ms)>;
+
+private:
+    HeroSocket socket;
+    uint16_t seq_num;
+    std::string server_host;
+    uint16_t server_port;
+    Endpoint server_ep;
+    FragmentManager fragment_mgr;
+    std::chrono::steady_clock::time_point last_ping;
+    int ping_ms;
+    std::vector<uint8_t> recv_buffer;
+    std::deque<Packet> inbox;
+
+    ConnectState connect_state;
+    std::chrono::steady_clock::time_point connect_start;
+    std::vector<uint8_t> conn_pubkey;
+    ConnectCallback on_connect;
+
+    PingState ping_state;
+    uint16_t ping_seq;
+    std::chrono::steady_clock::time_point ping_start;
+    PingCallback on_ping;
+
+    // Clock-sync pings are tracked apart from user pings so they never
+    // block Ping() / BeginPing()
+    LinkEstimator link;
+    ClockSync clock;
+    int sync_interval_ms;
+    bool sync_pending;
+    uint16_t sync_seq;
+    std::chrono::steady_clock::time_point sync_start;
+    std::chrono::steady_clock::time_point last_sync;
+
+    static const int PING_TIMEOUT_MS = 1000;
+    static const int KEEPALIVE_SECONDS = 5;
+
+    bool SendRaw(const Packet& pkt) {
+        return socket.SendTo(pkt.Serialize(), server_ep);
+    }
+
+    // Sends a packet the server acknowledges (SEEN/PONG) and times its round trip
+    bool SendTracked(const Packet& pkt) {
+        link.OnSend(pkt.seq);
+        return SendRaw(pkt);
+    }
+
+    // PING stamped with the local send time; every PONG feeds clock sync
+    bool SendPing(uint16_t& seq) {
+        std::vector<uint8_t> t0(Protocol::PING_SYNC_SIZE);
+        Detail::PutU64(t0.data(), static_cast<uint64_t>(LinkEstimator::NowMicros()));
+        seq = seq_num++;
+        return SendTracked(Packet::MakePing(seq, t0));
+    }
+
+    void FinishConnect(bool ok) {
+        connect_state = ok ? ConnectState::CONNECTED : ConnectState::FAILED;
+        if (ok) last_ping = std::chrono::steady_clock::now();
+        if (on_connect) {
+            auto callback = std::move(on_connect);
+            on_connect = nullptr;
+            callback(ok);
+        }
+    }
+
+    void FinishPing(bool ok) {
+        ping_state = ok ? PingState::DONE : PingState::TIMED_OUT;
+        if (ok) {
+            ping_ms = static_cast<int>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - ping_start).count());
+            last_ping = std::chrono::steady_clock::now();
+        }
+        if (on_ping) {
+            auto callback = std::move(on_ping);
+            on_ping = nullptr;
+            callback(ok, ping_ms);
+        }
+    }
+
+    void HandleSync(const uint8_t* p) {
+        int64_t t3 = LinkEstimator::NowMicros();
+        int64_t t0 = static_cast<int64_t>(Detail::GetU64(p));
+        int64_t t1 = static_cast<int64_t>(Detail::GetU64(p + 8));
+        int64_t t2 = static_cast<int64_t>(Detail::GetU64(p + 16));
+        clock.AddSample(t0, t1, t2, t3);
+        clock.SetTick(Detail::GetU32(p + 24), static_cast<int64_t>(Detail::GetU64(p + 28)),
+                      Detail::GetU32(p + 36));
+    }
+
+    // Transport control packets drive the state machines; everything else
+    // is acknowledged and queued for Receive.
+    void HandleIncoming(const PacketView& pkt, const Endpoint& from) {
+        switch (static_cast<Flag>(pkt.flag)) {
+            case Flag::SEEN:
+                link.OnAck(pkt.seq);
+                if (connect_state == ConnectState::CONNECTING) FinishConnect(true);
+                return;
+
+            case Flag::CONN:
+                if (connect_state == ConnectState::CONNECTING && pkt.payload_len > 0) {
+                    // Cookie challenge: echo it back with our key
+                    std::vector<uint8_t> cookie(pkt.payload, pkt.payload + pkt.payload_len);
+                    SendRaw(Packet::MakeConn(seq_num++, conn_pubkey, cookie));
+                }
+                return;
+
+            case Flag::PONG:
+                link.OnAck(pkt.seq);
+                if (pkt.payload_len >= Protocol::PONG_SYNC_SIZE) {
+                    HandleSync(pkt.payload);
+                }
+                if (ping_state == PingState::PENDING && pkt.seq == ping_seq) {
+                    FinishPing(true);
+                } else if (sync_pending && pkt.seq == sync_seq) {
+                    sync_pending = false;
+                    last_ping = std::chrono::steady_clock::now();
+                }
+                return;
+
+            case Flag::FRAG: {
+                auto [complete, data, original_flag] = fragment_mgr.AddFragment(pkt);
+                if (complete) {
+                    socket.SendTo(Packet::MakeSeen(pkt.seq).Serialize(), from);
+                    inbox.emplace_back(original_flag, pkt.seq, std::vector<uint8_t>(), data);
+                }
+                return;
+            }
+
+            default:
+                socket.SendTo(Packet::MakeSeen(pkt.seq).Serialize(), from);
+                inbox.emplace_back(pkt);
+                return;
+        }
+    }
+
+public:
+    HeroClient() : seq_num(0), server_port(0), ping_ms(0),
+                   recv_buffer(Protocol::MAX_PACKET_SIZE),
+                   connect_state(ConnectState::IDLE), ping_state(PingState::IDLE), ping_seq(0),
+                   sync_interval_ms(1000), sync_pending(false), sync_seq(0) {
+        last_ping = std::chrono::steady_clock::now();
+        last_sync = last_ping;
+    }
+
+    // Sends CONN and returns immediately; Update() completes the handshake
+    bool BeginConnect(const std::string& host, uint16_t port, const std::vector<uint8_t>& pubkey = {1, 2, 3, 4},
+                      ConnectCallback on_complete = nullptr) {
+        server_host = host;
+        server_port = port;
+        server_ep = Endpoint::FromString(host, port);
+        conn_pubkey = pubkey;
+        on_connect = std::move(on_complete);
+
+        // Zero cookie as padding: a valid first CONN is never smaller than the challenge
+        if (!SendRaw(Packet::MakeConn(seq_num++, conn_pubkey, std::vector<uint8_t>(Protocol::COOKIE_SIZE)))) {
+            connect_state = ConnectState::FAILED;
+            on_connect = nullptr;
+            return false;
+        }
+
+        connect_state = ConnectState::CONNECTING;
+        connect_start = std::chrono::steady_clock::now();
+        return true;
+    }
+
+    bool Connect(const std::string& host, uint16_t port, const std::vector<uint8_t>& pubkey = {1, 2, 3, 4}) {
+        if (!BeginConnect(host, port, pubkey)) {
+            return false;
+        }
+
+        while (connect_state == ConnectState::CONNECTING) {
+            Update();
+            if (connect_state == ConnectState::CONNECTING) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            }
+        }
+
+        return connect_state == ConnectState::CONNECTED;
+    }
+
+    bool Send(const std::vector<uint8_t>& data, const std::vector<uint8_t>& recipient_key = {}) {
+        if (!IsConnected()) return false;
+
+        auto pkt = Packet::MakeGive(seq_num++, recipient_key, data);
+        return SendTracked(pkt);
+    }
+
+    bool Send(const std::string& text, const std::vector<uint8_t>& recipient_key = {}) {
+        std::vector<uint8_t> data(text.begin(), text.end());
+        return Send(data, recipient_key);
+    }
+
+    template<typename... Args>
+    bool SendCommand(const std::string& command, Args... args) {
+        auto data = MagicWords::Encode(command, args...);
+        return Send(data);
+    }
+
+    template<typename... Args>
+    bool SendBinaryCommand(const std::string& command, const Args&... args) {
+        return Send(MagicWords::EncodeBinary(command, args...));
+    }
+
+    // Schema-declared message (see HERO_MESSAGE)
+    template<typename T, typename = std::enable_if_t<Messages::HasSchema<T>::value>>
+    bool Send(const T& msg, const std::vector<uint8_t>& recipient_key = {}) {
+        return Send(Messages::Encode(msg), recipient_key);
+    }
+
+    // Sends PING and returns immediately; Update() records the PONG
+    bool BeginPing(PingCallback on_complete = nullptr) {
+        if (!IsConnected() || ping_state == PingState::PENDING) return false;
+
+        if (!SendPing(ping_seq)) {
+            return false;
+        }
+
+        ping_state = PingState::PENDING;
+        ping_start = std::chrono::steady_clock::now();
+        last_sync = ping_start;
+        on_ping = std::move(on_complete);
+        return true;
+    }
+
+    bool Ping() {
+        if (!BeginPing()) return false;
+
+        while (ping_state == PingState::PENDING) {
+            Update();
+            if (ping_state == PingState::PENDING) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            }
+        }
+
+        return ping_state == PingState::DONE;
+    }
+
+    void KeepAlive() {
+        auto duration = std::chrono::duration_cast<std::chrono::seconds>(
+            std::chrono::steady_clock::now() - last_ping);
+        if (duration.count() > KEEPALIVE_SECONDS && ping_state != PingState::PENDING) {
+            BeginPing();
+        }
+    }
+
+    // Non-blocking receive pump: drains the socket, advances pending
+    // connect/ping requests and queues game packets for Receive.
+    void Update() {
+        PacketView pkt;
+        Endpoint from;
+
+        for (;;) {
+            int received = socket.RecvFrom(recv_buffer.data(), recv_buffer.size(), from);
+            if (received <= 0) break;
+            if (Packet::Parse(recv_buffer.data(), received, pkt) == ParseStatus::OK) {
+                HandleIncoming(pkt, from);
+            }
+        }
+
+        auto now = std::chrono::steady_clock::now();
+
+        // Clock sync rides on PING; sync quickly until the first few samples land.
+        // A sync PING whose PONG was lost is given up after PING_TIMEOUT_MS.
+        if (sync_pending &&
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - sync_start).count() >= PING_TIMEOUT_MS) {
+            sync_pending = false;
+        }
+        if (sync_interval_ms > 0 && IsConnected() && !sync_pending && ping_state != PingState::PENDING) {
+            int interval = clock.SampleCount() < 4 ? std::min(sync_interval_ms, 100) : sync_interval_ms;
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(now - last_sync).count() >= interval) {
+                sync_pending = SendPing(sync_seq);
+                sync_start = now;
+                last_sync = now;
+            }
+        }
+
+        if (connect_state == ConnectState::CONNECTING &&
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - connect_start).count() >= Protocol::DEFAULT_TIMEOUT_MS) {
+            FinishConnect(false);
+        }
+        if (ping_state == PingState::PENDING &&
+            std::chrono::duration_cast<std::chrono::milliseconds>(now - ping_start).count() >= PING_TIMEOUT_MS) {
+            FinishPing(false);
+        }
+    }
+
+    // Pops the next queued packet, pumping for up to timeout_ms (0 = poll once)
+    bool Receive(Packet& out_packet, int timeout_ms = 100) {
+        auto start = std::chrono::steady_clock::now();
+
+        for (;;) {
+            Update();
+            if (!inbox.empty()) {
+                out_packet = std::move(inbox.front());
+                inbox.pop_front();
+                return true;
+            }
+
+            if (std::chrono::duration_cast<std::chrono::milliseconds>(
+                    std::chrono::steady_clock::now() - start).count() >= timeout_ms) {
+                break;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+
+        fragment_mgr.CleanupStale();
+        return false;
+    }
 
     bool ReceiveString(std::string& out_text, int timeout_ms = 100) {
         Packet pkt;
@@ -652,15 +2400,32 @@ public:
     }
 
     void Disconnect() {
-        if (connected) {
-            auto stop_pkt = Packet::MakeStop(seq_num++);
-            socket.Send(stop_pkt.Serialize(), server_host, server_port);
-            connected = false;
+        if (connect_state == ConnectState::CONNECTED) {
+            SendRaw(Packet::MakeStop(seq_num++));
         }
+        connect_state = ConnectState::IDLE;
+        ping_state = PingState::IDLE;
+        sync_pending = false;
+        on_connect = nullptr;
+        on_ping = nullptr;
     }
 
-    bool IsConnected() const { return connected; }
+    bool IsConnected() const { return connect_state == ConnectState::CONNECTED; }
+    ConnectState GetConnectState() const { return connect_state; }
+    PingState GetPingState() const { return ping_state; }
     int GetPing() const { return ping_ms; }
+
+    // Continuous RTT/jitter/loss measured from acks of ordinary traffic
+    const LinkStats& GetLinkStats() const { return link.GetStats(); }
+
+    // Server clock (microseconds on the server's timeline) and tick estimates
+    int64_t ServerTimeNow() const { return clock.ServerTime(LinkEstimator::NowMicros()); }
+    double EstimatedServerTick() const { return clock.ServerTick(LinkEstimator::NowMicros()); }
+    bool IsClockSynced() const { return clock.IsSynced(); }
+    const ClockSync& GetClockSync() const { return clock; }
+
+    // How often Update() sends a sync PING once synced (0 disables auto sync)
+    void SetClockSyncInterval(int interval_ms) { sync_interval_ms = interval_ms; }
 };
 
 // Server class
@@ -672,331 +2437,2786 @@ private:
         std::vector<uint8_t> pubkey;
         std::chrono::steady_clock::time_point last_seen;
         std::chrono::steady_clock::time_point last_ping;
+        uint16_t next_seq = 0;
+        LinkEstimator link;
     };
 
     HeroSocket socket;
     uint16_t port;
     bool running;
+    bool use_cookies;
+    std::function<void(std::exception_ptr, const std::string&, uint16_t)> error_handler;
     FragmentManager fragment_mgr;
+    ConnCookies cookies;
+    RateLimiter limiter;
+    ServerStats stats;
+    std::vector<uint8_t> recv_buffer;
     std::unordered_map<std::string, Client> clients;
 
-    std::string MakeClientKey(const std::string& host, uint16_t port) {
+    std::chrono::steady_clock::time_point time_epoch;
+    uint32_t tick;
+    int64_t tick_time_us;
+    uint32_t tick_interval_us;
+
+    std::string MakeClientKey(const std::string& host, uint16_t port) const {
         return host + ":" + std::to_string(port);
     }
 
+    // GIVE to a known client with its own sequence, so its SEEN yields an RTT sample
+    void SendToClient(Client& client, const std::vector<uint8_t>& data) {
+        auto pkt = Packet::MakeGive(client.next_seq++, {}, data);
+        client.link.OnSend(pkt.seq);
+        socket.Send(pkt.Serialize(), client.host, client.port);
+    }
+
+    // Verifies a CONN's cookie straight from the receive buffer. Returns true
+    // when the cookie is valid and the CONN needs full handling; otherwise
+    // answers with a challenge and returns false. CONNs shorter than the
+    // reply are dropped so the challenge cannot amplify spoofed traffic;
+    // clients pad the first CONN to cookie size.
+    bool ChallengeConn(const uint8_t* data, size_t len, const Endpoint& from) {
+        uint16_t payload_len = (data[4] << 8) | data[5];
+        uint16_t req_len = (data[6] << 8) | data[7];
+        size_t cookie_offset = Protocol::HEADER_SIZE + req_len;
+
+        if (len >= cookie_offset + payload_len &&
+            cookies.Verify(from, data + cookie_offset, payload_len)) {
+            return true;
+        }
+
+        uint8_t reply[Protocol::HEADER_SIZE + Protocol::COOKIE_SIZE] = {
+            static_cast<uint8_t>(Flag::CONN), Protocol::VERSION, data[2], data[3],
+            0, static_cast<uint8_t>(Protocol::COOKIE_SIZE), 0, 0
+        };
+        if (len < sizeof(reply)) return false;
+        cookies.Make(from, reply + Protocol::HEADER_SIZE);
+        socket.SendTo(reply, sizeof(reply), from);
+        return false;
+    }
+
+    // PONG payload for clock sync: echo of t0, receive/send times, current tick
+    std::vector<uint8_t> MakeSyncReply(const PacketView& ping, int64_t t1) const {
+        std::vector<uint8_t> reply(Protocol::PONG_SYNC_SIZE);
+        uint8_t* p = reply.data();
+        std::memcpy(p, ping.payload, Protocol::PING_SYNC_SIZE);
+        Detail::PutU64(p + 8, static_cast<uint64_t>(t1));
+        Detail::PutU32(p + 24, tick);
+        Detail::PutU64(p + 28, static_cast<uint64_t>(tick_time_us));
+        Detail::PutU32(p + 36, tick_interval_us);
+        Detail::PutU64(p + 16, static_cast<uint64_t>(ServerTimeMicros()));
+        return reply;
+    }
+
 public:
-    HeroServer(uint16_t listen_port) : port(listen_port), running(false) {
+    HeroServer(uint16_t listen_port)
+        : port(listen_port), running(false), use_cookies(true),
+          recv_buffer(Protocol::MAX_PACKET_SIZE),
+          time_epoch(std::chrono::steady_clock::now()),
+          tick(0), tick_time_us(0), tick_interval_us(0) {
         socket.Bind(port);
     }
 
     void Start() { running = true; }
     void Stop() { running = false; }
 
+    // Shared timeline: microseconds since the server started
+    int64_t ServerTimeMicros() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - time_epoch).count();
+    }
+
+    // Call at the start of each simulation tick; clients extrapolate from it
+    void SetTick(uint32_t current_tick) {
+        tick = current_tick;
+        tick_time_us = ServerTimeMicros();
+    }
+
+    void SetTickRate(double hz) {
+        tick_interval_us = hz > 0.0 ? static_cast<uint32_t>(1e6 / hz) : 0;
+    }
+
+    uint32_t GetTick() const { return tick; }
+
+    // Require the stateless cookie round trip before allocating client state
+    void SetConnCookies(bool enabled) { use_cookies = enabled; }
+
+    // Receives exceptions thrown by the Poll handler. Without one, Poll
+    // rethrows them to the caller after counting.
+    void SetErrorHandler(std::function<void(std::exception_ptr, const std::string&, uint16_t)> on_error) {
+        error_handler = std::move(on_error);
+    }
+
+    // Drop malformed/wrong-version datagrams in the kernel (Linux)
+    bool EnablePacketFilter() { return socket.AttachPacketFilter(); }
+    void DisablePacketFilter() { socket.DetachPacketFilter(); }
+    SocketFilterStats GetFilterStats() const { return socket.GetFilterStats(); }
+
+    // Token buckets checked on the raw datagram, before any parsing
+    void SetRateLimits(const RateLimitConfig& config) { limiter.Configure(config); }
+    const RateLimitConfig& GetRateLimits() const { return limiter.GetConfig(); }
+
     bool Poll(std::function<void(const Packet&, const std::string&, uint16_t)> handler = nullptr) {
+        return PollImpl([&](const PacketView& pkt, const std::string& host, uint16_t from_port) {
+            if (handler) handler(Packet(pkt), host, from_port);
+        });
+    }
+
+    // Like Poll, but hands the handler a zero-copy CommandView of the payload
+    bool PollCommands(std::function<void(const CommandView&, const std::string&, uint16_t)> handler) {
+        return PollImpl([&](const PacketView& pkt, const std::string& host, uint16_t from_port) {
+            if (handler) handler(CommandView(pkt.payload, pkt.payload_len), host, from_port);
+        });
+    }
+
+    bool PollCommands(const CommandDispatcher& dispatcher) {
+        return PollImpl([&](const PacketView& pkt, const std::string& host, uint16_t from_port) {
+            dispatcher.Dispatch(CommandView(pkt.payload, pkt.payload_len), host, from_port);
+        });
+    }
+
+private:
+    template<typename Deliver>
+    bool PollImpl(Deliver&& deliver) {
         if (!running) return false;
 
-        std::vector<uint8_t> buffer;
-        std::string from_host;
-        uint16_t from_port;
-
-        if (socket.Recv(buffer, from_host, from_port)) {
-            try {
-                auto pkt = Packet::Deserialize(buffer);
-                std::string client_key = MakeClientKey(from_host, from_port);
-
-                if (pkt.flag == static_cast<uint8_t>(Flag::FRAG)) {
-                    auto [complete, data, original_flag] = fragment_mgr.AddFragment(pkt);
-                    if (complete) {
-                        pkt = Packet(original_flag, pkt.seq, {}, data);
-                        auto seen = Packet::MakeSeen(pkt.seq);
-                        socket.Send(seen.Serialize(), from_host, from_port);
-                    } else {
-                        return false;
-                    }
-                }
+        Endpoint from;
+        int received = socket.RecvFrom(recv_buffer.data(), recv_buffer.size(), from);
 
-                if (pkt.flag == static_cast<uint8_t>(Flag::CONN)) {
-                    Client c;
-                    c.host = from_host;
-                    c.port = from_port;
-                    c.pubkey = pkt.requirements;
-                    c.last_seen = std::chrono::steady_clock::now();
-                    c.last_ping = std::chrono::steady_clock::now();
-                    clients[client_key] = c;
-
-                    auto seen = Packet::MakeSeen(pkt.seq);
-                    socket.Send(seen.Serialize(), from_host, from_port);
-                } else if (pkt.flag == static_cast<uint8_t>(Flag::STOP)) {
-                    clients.erase(client_key);
-                    auto seen = Packet::MakeSeen(pkt.seq);
-                    socket.Send(seen.Serialize(), from_host, from_port);
-                } else if (pkt.flag == static_cast<uint8_t>(Flag::PING)) {
-                    if (clients.find(client_key) != clients.end()) {
-                        clients[client_key].last_ping = std::chrono::steady_clock::now();
-                    }
-                    auto pong = Packet::MakePong(pkt.seq);
-                    socket.Send(pong.Serialize(), from_host, from_port);
-                } else {
-                    if (clients.find(client_key) != clients.end()) {
-                        clients[client_key].last_seen = std::chrono::steady_clock::now();
-                    }
+        if (received > 0) {
+            int64_t recv_us = ServerTimeMicros();
+            stats.received++;
+
+            RateClass cls = RateLimiter::ClassOf(recv_buffer[0]);
+            if (!limiter.Allow(from, cls)) {
+                stats.rate_limited[static_cast<int>(cls)]++;
+                return false;
+            }
+
+            bool conn_verified = false;
+            if (use_cookies && received >= Protocol::HEADER_SIZE &&
+                recv_buffer[0] == static_cast<uint8_t>(Flag::CONN) &&
+                recv_buffer[1] == Protocol::VERSION) {
+                if (!ChallengeConn(recv_buffer.data(), received, from)) return true;
+                conn_verified = true;
+            }
+
+            PacketView pkt;
+            if (Packet::Parse(recv_buffer.data(), received, pkt) != ParseStatus::OK) {
+                stats.malformed++;
+                fragment_mgr.CleanupStale();
+                return false;
+            }
+
+            std::string from_host = from.Host();
+            uint16_t from_port = from.port;
+            std::string client_key = MakeClientKey(from_host, from_port);
+
+            std::vector<uint8_t> reassembled;
+            if (pkt.flag == static_cast<uint8_t>(Flag::FRAG)) {
+                auto [complete, data, original_flag] = fragment_mgr.AddFragment(pkt);
+                if (!complete) {
+                    return false;
+                }
+
+                reassembled = std::move(data);
+                pkt.flag = static_cast<uint8_t>(original_flag);
+                pkt.requirements = nullptr;
+                pkt.requirements_len = 0;
+                pkt.payload = reassembled.data();
+                pkt.payload_len = static_cast<uint16_t>(reassembled.size());
+
+                auto seen = Packet::MakeSeen(pkt.seq);
+                socket.SendTo(seen.Serialize(), from);
+            }
+
+            if (pkt.flag == static_cast<uint8_t>(Flag::CONN)) {
+                // Only a CONN reassembled from fragments still needs its cookie checked
+                if (use_cookies && !conn_verified && !cookies.Verify(from, pkt.payload, pkt.payload_len)) {
+                    return false;
+                }
+
+                Client c;
+                c.host = from_host;
+                c.port = from_port;
+                c.pubkey.assign(pkt.requirements, pkt.requirements + pkt.requirements_len);
+                c.last_seen = std::chrono::steady_clock::now();
+                c.last_ping = std::chrono::steady_clock::now();
+                clients[client_key] = c;
+
+                auto seen = Packet::MakeSeen(pkt.seq);
+                socket.SendTo(seen.Serialize(), from);
+            } else if (pkt.flag == static_cast<uint8_t>(Flag::STOP)) {
+                clients.erase(client_key);
+                auto seen = Packet::MakeSeen(pkt.seq);
+                socket.SendTo(seen.Serialize(), from);
+            } else if (pkt.flag == static_cast<uint8_t>(Flag::SEEN)) {
+                // Ack of one of our sends: feeds the link estimator, never re-acked
+                auto it = clients.find(client_key);
+                if (it != clients.end()) {
+                    it->second.last_seen = std::chrono::steady_clock::now();
+                    it->second.link.OnAck(pkt.seq);
+                }
+            } else if (pkt.flag == static_cast<uint8_t>(Flag::PING)) {
+                auto it = clients.find(client_key);
+                if (it != clients.end()) {
+                    it->second.last_ping = std::chrono::steady_clock::now();
+                }
+                auto pong = pkt.payload_len >= Protocol::PING_SYNC_SIZE
+                    ? Packet::MakePong(pkt.seq, MakeSyncReply(pkt, recv_us))
+                    : Packet::MakePong(pkt.seq);
+                socket.SendTo(pong.Serialize(), from);
+            } else {
+                auto it = clients.find(client_key);
+                if (it != clients.end()) {
+                    it->second.last_seen = std::chrono::steady_clock::now();
+                }
+
+                auto seen = Packet::MakeSeen(pkt.seq);
+                socket.SendTo(seen.Serialize(), from);
+
+                try {
+                    deliver(pkt, from_host, from_port);
+                } catch (...) {
+                    stats.handler_errors++;
+                    if (!error_handler) throw;
+                    error_handler(std::current_exception(), from_host, from_port);
+                }
+            }
+
+            return true;
+        }
+
+        fragment_mgr.CleanupStale();
+        return false;
+    }
+
+public:
+    void SendTo(const std::vector<uint8_t>& data, const std::string& host, uint16_t port) {
+        auto it = clients.find(MakeClientKey(host, port));
+        if (it != clients.end()) {
+            SendToClient(it->second, data);
+            return;
+        }
+
+        auto pkt = Packet::MakeGive(0, {}, data);
+        socket.Send(pkt.Serialize(), host, port);
+    }
+
+    void SendTo(const std::string& text, const std::string& host, uint16_t port) {
+        std::vector<uint8_t> data(text.begin(), text.end());
+        SendTo(data, host, port);
+    }
+
+    void Broadcast(const std::vector<uint8_t>& data) {
+        for (auto& [key, client] : clients) {
+            SendToClient(client, data);
+        }
+    }
+
+    void Broadcast(const std::string& text) {
+        std::vector<uint8_t> data(text.begin(), text.end());
+        Broadcast(data);
+    }
+
+    // Schema-declared messages (see HERO_MESSAGE)
+    template<typename T, typename = std::enable_if_t<Messages::HasSchema<T>::value>>
+    void SendTo(const T& msg, const std::string& host, uint16_t port) {
+        SendTo(Messages::Encode(msg), host, port);
+    }
+
+    template<typename T, typename = std::enable_if_t<Messages::HasSchema<T>::value>>
+    void Broadcast(const T& msg) {
+        Broadcast(Messages::Encode(msg));
+    }
+
+    int GetClientCount() const { return clients.size(); }
+    bool IsRunning() const { return running; }
+    const ServerStats& GetStats() const { return stats; }
+
+    // RTT/jitter/loss of a connected client; false if the client is unknown
+    bool GetClientLinkStats(const std::string& host, uint16_t port, LinkStats& out) const {
+        auto it = clients.find(MakeClientKey(host, port));
+        if (it == clients.end()) return false;
+        out = it->second.link.GetStats();
+        return true;
+    }
+};
+
+} // namespace HERO
+
+#endif // HERO_H
+
+
+// ============================================================================
+// HEROGAME.h - Game Framework
+// ============================================================================
+
+#ifndef HEROGAME_H
+#define HEROGAME_H
+
+#include <cmath>
+#include <random>
+#include <new>
+
+#if defined(__AVX__) || defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+namespace HERO {
+namespace Game {
+
+// ============================================================================
+// GAME STATE SYNCHRONIZATION
+// ============================================================================
+
+// Keys are interned to dense KeyIds; values live in compact typed cells
+// indexed by KeyId, so typed reads are an array lookup with no parsing.
+// The string-keyed API is a compatibility layer over the same cells.
+class GameState {
+public:
+    using KeyId = uint32_t;
+    static constexpr KeyId INVALID_KEY = 0xFFFFFFFF;
+
+    enum class ValueType : uint8_t { NONE, INT, FLOAT, BOOL, STRING };
+
+private:
+    struct Cell {
+        ValueType type;
+        union {
+            int32_t i;
+            float f;
+            bool b;
+            uint32_t str;  // Index into strings
+        };
+
+        Cell() : type(ValueType::NONE), i(0) {}
+    };
+
+    std::vector<Cell> cells;
+    std::vector<std::string> names;
+    std::unordered_map<std::string, KeyId> ids;
+    std::vector<std::string> strings;
+    uint32_t version;
+
+    // Keys in order of last change (oldest first), so a delta walks only
+    // the keys changed since the requested version.
+    std::vector<uint32_t> changed_at;
+    std::vector<KeyId> prev_changed;
+    std::vector<KeyId> next_changed;
+    KeyId oldest_changed;
+    KeyId newest_changed;
+
+    // Serialize() cache: one encoded "key=value;" segment per key, and the
+    // joined result keyed by revision (bumped on every change, unlike
+    // version which Deserialize can move backwards).
+    uint64_t revision;
+    mutable uint64_t serialized_revision;
+    mutable std::string serialized;
+    mutable std::vector<std::string> segments;
+    mutable std::vector<uint8_t> segment_stale;
+    mutable std::vector<KeyId> stale_keys;
+
+    void MarkStale(KeyId id) {
+        revision++;
+        if (!segment_stale[id]) {
+            segment_stale[id] = 1;
+            stale_keys.push_back(id);
+        }
+    }
+
+    void Touch(KeyId id) {
+        changed_at[id] = version;
+        if (newest_changed == id) return;
+        if (prev_changed[id] != INVALID_KEY) next_changed[prev_changed[id]] = next_changed[id];
+        if (next_changed[id] != INVALID_KEY) prev_changed[next_changed[id]] = prev_changed[id];
+        if (oldest_changed == id) oldest_changed = next_changed[id];
+        prev_changed[id] = newest_changed;
+        next_changed[id] = INVALID_KEY;
+        if (newest_changed != INVALID_KEY) next_changed[newest_changed] = id;
+        newest_changed = id;
+        if (oldest_changed == INVALID_KEY) oldest_changed = id;
+    }
+
+    KeyId Find(const std::string& key) const {
+        auto it = ids.find(key);
+        return (it != ids.end()) ? it->second : INVALID_KEY;
+    }
+
+    const Cell* CellAt(KeyId id) const {
+        return (id < cells.size() && cells[id].type != ValueType::NONE) ? &cells[id] : nullptr;
+    }
+
+    // Null for ids this state never issued (INVALID_KEY, stale ids), which
+    // makes setters ignore them
+    Cell* Assign(KeyId id, ValueType type) {
+        if (id >= cells.size()) return nullptr;
+        Cell& c = cells[id];
+        if (type != ValueType::STRING && c.type == ValueType::STRING) strings[c.str].clear();
+        if (type == ValueType::STRING && c.type != ValueType::STRING) {
+            c.str = id;  // One string slot per key, reused across writes
+            if (strings.size() <= id) strings.resize(id + 1);
+        }
+        c.type = type;
+        version++;
+        Touch(id);
+        MarkStale(id);
+        return &c;
+    }
+
+    static std::string ToText(const Cell& c, const std::vector<std::string>& strings) {
+        switch (c.type) {
+            case ValueType::INT: return std::to_string(c.i);
+            case ValueType::FLOAT: return std::to_string(c.f);
+            case ValueType::BOOL: return c.b ? "true" : "false";
+            case ValueType::STRING: return strings[c.str];
+            default: return "";
+        }
+    }
+
+    // Text values become typed cells only when they round-trip exactly,
+    // so Get() returns what was sent.
+    void SetFromText(KeyId id, const std::string& text) {
+        int32_t i;
+        float f;
+        if (text == "true" || text == "false") {
+            Set(id, text == "true");
+        } else if (CommandView::Parse(text, i) && std::to_string(i) == text) {
+            Set(id, static_cast<int>(i));
+        } else if (CommandView::Parse(text, f) && std::to_string(f) == text) {
+            Set(id, f);
+        } else {
+            Set(id, text);
+        }
+    }
+
+public:
+    GameState()
+        : version(0), oldest_changed(INVALID_KEY), newest_changed(INVALID_KEY),
+          revision(0), serialized_revision(~0ULL) {}
+
+    // Interns `key`; the id stays valid for the life of this state
+    KeyId Key(const std::string& key) {
+        auto it = ids.find(key);
+        if (it != ids.end()) return it->second;
+        KeyId id = static_cast<KeyId>(names.size());
+        ids.emplace(key, id);
+        names.push_back(key);
+        cells.emplace_back();
+        changed_at.push_back(0);
+        prev_changed.push_back(INVALID_KEY);
+        next_changed.push_back(INVALID_KEY);
+        segments.emplace_back();
+        segment_stale.push_back(0);
+        return id;
+    }
+
+    const std::string& KeyName(KeyId id) const {
+        static const std::string none;
+        return id < names.size() ? names[id] : none;
+    }
+
+    // Typed access by KeyId; writes to unknown ids are ignored
+
+    void Set(KeyId id, int value) {
+        if (Cell* c = Assign(id, ValueType::INT)) c->i = value;
+    }
+
+    void Set(KeyId id, float value) {
+        if (Cell* c = Assign(id, ValueType::FLOAT)) c->f = value;
+    }
+
+    void Set(KeyId id, bool value) {
+        if (Cell* c = Assign(id, ValueType::BOOL)) c->b = value;
+    }
+
+    void Set(KeyId id, const std::string& value) {
+        if (Cell* c = Assign(id, ValueType::STRING)) strings[c->str] = value;
+    }
+
+    void Set(KeyId id, const char* value) { Set(id, std::string(value)); }
+
+    bool Has(KeyId id) const { return CellAt(id) != nullptr; }
+
+    ValueType TypeOf(KeyId id) const {
+        const Cell* c = CellAt(id);
+        return c ? c->type : ValueType::NONE;
+    }
+
+    int GetInt(KeyId id, int default_val = 0) const {
+        const Cell* c = CellAt(id);
+        if (!c) return default_val;
+        switch (c->type) {
+            case ValueType::INT: return c->i;
+            case ValueType::FLOAT: return static_cast<int>(c->f);
+            case ValueType::BOOL: return c->b ? 1 : 0;
+            default: {
+                int v;
+                return CommandView::Parse(strings[c->str], v) ? v : default_val;
+            }
+        }
+    }
+
+    float GetFloat(KeyId id, float default_val = 0.0f) const {
+        const Cell* c = CellAt(id);
+        if (!c) return default_val;
+        switch (c->type) {
+            case ValueType::FLOAT: return c->f;
+            case ValueType::INT: return static_cast<float>(c->i);
+            case ValueType::BOOL: return c->b ? 1.0f : 0.0f;
+            default: {
+                float v;
+                return CommandView::Parse(strings[c->str], v) ? v : default_val;
+            }
+        }
+    }
+
+    bool GetBool(KeyId id, bool default_val = false) const {
+        const Cell* c = CellAt(id);
+        if (!c) return default_val;
+        switch (c->type) {
+            case ValueType::BOOL: return c->b;
+            case ValueType::INT: return c->i != 0;
+            case ValueType::FLOAT: return c->f != 0.0f;
+            default: return strings[c->str].empty() ? default_val : strings[c->str] == "true";
+        }
+    }
+
+    std::string Get(KeyId id, const std::string& default_val = "") const {
+        const Cell* c = CellAt(id);
+        return c ? ToText(*c, strings) : default_val;
+    }
+
+    // String-keyed compatibility layer
+
+    void Set(const std::string& key, const std::string& value) { Set(Key(key), value); }
+    void Set(const std::string& key, const char* value) { Set(Key(key), std::string(value)); }
+    void Set(const std::string& key, int value) { Set(Key(key), value); }
+    void Set(const std::string& key, float value) { Set(Key(key), value); }
+    void Set(const std::string& key, bool value) { Set(Key(key), value); }
+
+    std::string Get(const std::string& key, const std::string& default_val = "") const {
+        return Get(Find(key), default_val);
+    }
+
+    int GetInt(const std::string& key, int default_val = 0) const {
+        return GetInt(Find(key), default_val);
+    }
+
+    float GetFloat(const std::string& key, float default_val = 0.0f) const {
+        return GetFloat(Find(key), default_val);
+    }
+
+    bool GetBool(const std::string& key, bool default_val = false) const {
+        return GetBool(Find(key), default_val);
+    }
+
+    // Cached until the next change; only changed keys are re-encoded.
+    // Not safe to call concurrently with itself on the same state.
+    const std::string& SerializeCached() const {
+        if (serialized_revision == revision) return serialized;
+
+        size_t total = 0;
+        for (KeyId id : stale_keys) {
+            std::string& seg = segments[id];
+            seg.clear();
+            if (cells[id].type != ValueType::NONE) {
+                seg.append(names[id]).append("=").append(ToText(cells[id], strings)).append(";");
+            }
+            segment_stale[id] = 0;
+        }
+        stale_keys.clear();
+
+        for (const std::string& seg : segments) total += seg.size();
+        serialized = std::to_string(version);
+        serialized.reserve(serialized.size() + 1 + total);
+        serialized.push_back('|');
+        for (const std::string& seg : segments) serialized.append(seg);
+        serialized_revision = revision;
+        return serialized;
+    }
+
+    std::string Serialize() const { return SerializeCached(); }
+
+    // Clears values but keeps interned KeyIds valid
+    void Deserialize(const std::string& data) {
+        for (KeyId id = 0; id < cells.size(); id++) {
+            if (cells[id].type == ValueType::STRING) strings[cells[id].str].clear();
+            cells[id].type = ValueType::NONE;
+            changed_at[id] = 0;
+            MarkStale(id);
+        }
+        revision++;
+        version = 0;
+        size_t pipe_pos = data.find('|');
+        if (pipe_pos == std::string::npos) return;
+
+        std::string pairs = data.substr(pipe_pos + 1);
+
+        size_t pos = 0;
+        while (pos < pairs.length()) {
+            size_t eq = pairs.find('=', pos);
+            size_t semi = pairs.find(';', eq);
+            if (eq == std::string::npos || semi == std::string::npos) break;
+
+            std::string key = pairs.substr(pos, eq - pos);
+            std::string value = pairs.substr(eq + 1, semi - eq - 1);
+            SetFromText(Key(key), value);
+
+            pos = semi + 1;
+        }
+
+        version = std::stoul(data.substr(0, pipe_pos));
+    }
+
+    // Keys whose value changed after version `since`, oldest change first
+    std::vector<KeyId> ChangedSince(uint32_t since) const {
+        std::vector<KeyId> out;
+        for (KeyId id = newest_changed; id != INVALID_KEY && changed_at[id] > since; id = prev_changed[id]) {
+            out.push_back(id);
+        }
+        std::reverse(out.begin(), out.end());
+        return out;
+    }
+
+    // "since|version|key=value;..." holding only keys changed after `since`
+    std::string SerializeDelta(uint32_t since) const {
+        std::stringstream ss;
+        ss << since << "|" << version << "|";
+        for (KeyId id : ChangedSince(since)) {
+            if (cells[id].type == ValueType::NONE) continue;
+            ss << names[id] << "=" << ToText(cells[id], strings) << ";";
+        }
+        return ss.str();
+    }
+
+    // Applies a SerializeDelta() result. Returns false if this state is older
+    // than the delta's base version (a full state is needed instead); deltas
+    // this state has already reached are ignored.
+    bool ApplyDelta(const std::string& data) {
+        size_t first = data.find('|');
+        size_t second = (first == std::string::npos) ? first : data.find('|', first + 1);
+        if (second == std::string::npos) return false;
+
+        uint32_t base, target;
+        if (!CommandView::Parse(std::string_view(data).substr(0, first), base) ||
+            !CommandView::Parse(std::string_view(data).substr(first + 1, second - first - 1), target)) {
+            return false;
+        }
+        if (version < base) return false;
+        if (version >= target) return true;
+
+        // Applied keys are stamped with the delta's version so the change
+        // list stays ordered: every key already in it changed at or before
+        // the current version, which is below `target`.
+        size_t pos = second + 1;
+        while (pos < data.length()) {
+            size_t eq = data.find('=', pos);
+            size_t semi = data.find(';', eq);
+            if (eq == std::string::npos || semi == std::string::npos) break;
+
+            KeyId id = Key(data.substr(pos, eq - pos));
+            SetFromText(id, data.substr(eq + 1, semi - eq - 1));
+            version = target;
+            Touch(id);
+            pos = semi + 1;
+        }
+        version = target;
+        revision++;
+        return true;
+    }
+
+    uint32_t GetVersion() const { return version; }
+};
+
+// ============================================================================
+// VECTOR2 - Simple 2D vector for game math
+// ============================================================================
+
+struct Vector2 {
+    float x, y;
+
+    Vector2() : x(0), y(0) {}
+    Vector2(float x, float y) : x(x), y(y) {}
+
+    Vector2 operator+(const Vector2& other) const {
+        return Vector2(x + other.x, y + other.y);
+    }
+
+    Vector2 operator-(const Vector2& other) const {
+        return Vector2(x - other.x, y - other.y);
+    }
+
+    Vector2 operator*(float scalar) const {
+        return Vector2(x * scalar, y * scalar);
+    }
+
+    float Length() const {
+        return std::sqrt(x * x + y * y);
+    }
+
+    Vector2 Normalized() const {
+        float len = Length();
+        return len > 0 ? Vector2(x / len, y / len) : Vector2(0, 0);
+    }
+
+    float Distance(const Vector2& other) const {
+        return (*this - other).Length();
+    }
+
+    std::string ToString() const {
+        return std::to_string(x) + "," + std::to_string(y);
+    }
+
+    static Vector2 FromString(const std::string& str) {
+        size_t comma = str.find(',');
+        if (comma == std::string::npos) return Vector2();
+        return Vector2(std::stof(str.substr(0, comma)),
+                      std::stof(str.substr(comma + 1)));
+    }
+
+    void Write(BitWriter& w, const Quantization& q) const {
+        w.WriteQuantized(x, q);
+        w.WriteQuantized(y, q);
+    }
+
+    bool Read(BitReader& r, const Quantization& q) {
+        return r.ReadQuantized(x, q) && r.ReadQuantized(y, q);
+    }
+
+    // Direction only; the length is dropped
+    void WriteDirection(BitWriter& w, int bits = 12) const {
+        w.WriteUnitVector(x, y, bits);
+    }
+
+    bool ReadDirection(BitReader& r, int bits = 12) {
+        return r.ReadUnitVector(x, y, bits);
+    }
+};
+
+// Default world ranges for bit-packed entity state
+const Quantization POSITION_QUANT(-4096.0f, 4096.0f, 1.0f / 64.0f);
+const Quantization VELOCITY_QUANT(-512.0f, 512.0f, 1.0f / 64.0f);
+
+// ============================================================================
+// ENTITY HANDLES - 32-bit index + generation identifiers
+// ============================================================================
+
+// Low 20 bits index a slot, high 12 bits hold the slot's generation, which
+// changes whenever the slot is reused, so stale handles never resolve. The
+// generation is never 0, so 0 is the invalid handle.
+struct EntityHandle {
+    static constexpr uint32_t INDEX_BITS = 20;
+    static constexpr uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+    static constexpr uint32_t MAX_GENERATION = (1u << (32 - INDEX_BITS)) - 1;
+
+    uint32_t value;
+
+    constexpr EntityHandle() : value(0) {}
+    constexpr explicit EntityHandle(uint32_t raw) : value(raw) {}
+
+    static constexpr EntityHandle Make(uint32_t index, uint32_t generation) {
+        return EntityHandle((generation << INDEX_BITS) | (index & INDEX_MASK));
+    }
+
+    constexpr uint32_t Index() const { return value & INDEX_MASK; }
+    constexpr uint32_t Generation() const { return value >> INDEX_BITS; }
+    constexpr bool IsValid() const { return value != 0; }
+    constexpr explicit operator bool() const { return value != 0; }
+
+    constexpr bool operator==(const EntityHandle& other) const { return value == other.value; }
+    constexpr bool operator!=(const EntityHandle& other) const { return value != other.value; }
+    constexpr bool operator<(const EntityHandle& other) const { return value < other.value; }
+};
+
+// Hands out handles and retires them. Freed slots are reused oldest-first
+// to delay generation wrap-around.
+class HandleAllocator {
+private:
+    std::vector<uint16_t> generations;
+    std::deque<uint32_t> free_slots;
+
+public:
+    EntityHandle Allocate() {
+        uint32_t index;
+        if (!free_slots.empty()) {
+            index = free_slots.front();
+            free_slots.pop_front();
+        } else {
+            index = static_cast<uint32_t>(generations.size());
+            if (index > EntityHandle::INDEX_MASK) {
+                throw std::length_error("Entity handle space exhausted");
+            }
+            generations.push_back(1);
+        }
+        return EntityHandle::Make(index, generations[index]);
+    }
+
+    bool Release(EntityHandle h) {
+        if (!IsAlive(h)) return false;
+        uint16_t& gen = generations[h.Index()];
+        gen = (gen == EntityHandle::MAX_GENERATION) ? 1 : gen + 1;
+        free_slots.push_back(h.Index());
+        return true;
+    }
+
+    bool IsAlive(EntityHandle h) const {
+        return h.IsValid() && h.Index() < generations.size() && generations[h.Index()] == h.Generation();
+    }
+
+    size_t Capacity() const { return generations.size(); }
+
+    void Clear() {
+        generations.clear();
+        free_slots.clear();
+    }
+};
+
+// Slot array keyed by handle index; lookups check the full handle, so a
+// stale handle misses instead of aliasing a newer entity.
+template<typename T>
+class HandleMap {
+private:
+    struct Slot {
+        EntityHandle handle;
+        T value;
+    };
+
+    std::vector<Slot> slots;
+    size_t count = 0;
+
+public:
+    // Inserts or overwrites; replaces an older generation in the same slot
+    T& Insert(EntityHandle h, T value) {
+        if (h.Index() >= slots.size()) slots.resize(h.Index() + 1);
+        Slot& slot = slots[h.Index()];
+        if (!slot.handle) count++;
+        slot.handle = h;
+        slot.value = std::move(value);
+        return slot.value;
+    }
+
+    T* Find(EntityHandle h) {
+        if (!h || h.Index() >= slots.size() || slots[h.Index()].handle != h) return nullptr;
+        return &slots[h.Index()].value;
+    }
+
+    const T* Find(EntityHandle h) const {
+        return const_cast<HandleMap*>(this)->Find(h);
+    }
+
+    bool Erase(EntityHandle h) {
+        if (!Find(h)) return false;
+        Slot& slot = slots[h.Index()];
+        slot.handle = EntityHandle();
+        slot.value = T();
+        count--;
+        return true;
+    }
+
+    template<typename F>
+    void ForEach(F&& f) const {
+        for (const Slot& slot : slots) {
+            if (slot.handle) f(slot.handle, slot.value);
+        }
+    }
+
+    size_t Size() const { return count; }
+
+    void Clear() {
+        slots.clear();
+        count = 0;
+    }
+};
+
+// ============================================================================
+// ENTITY - Game object with position, velocity, and properties
+// ============================================================================
+
+class Entity {
+public:
+    EntityHandle handle;
+    std::string id;  // Optional name
+    Vector2 position;
+    Vector2 velocity;
+    std::unordered_map<std::string, std::string> properties;
+
+    Entity(const std::string& id = "") : id(id) {}
+
+    void SetProperty(const std::string& key, const std::string& value) {
+        properties[key] = value;
+    }
+
+    std::string GetProperty(const std::string& key, const std::string& default_val = "") const {
+        auto it = properties.find(key);
+        return (it != properties.end()) ? it->second : default_val;
+    }
+
+    void Update(float deltaTime) {
+        position = position + velocity * deltaTime;
+    }
+
+    // Bit-packed position and velocity (properties are not included)
+    void WriteMotion(BitWriter& w, const Quantization& pos_q = POSITION_QUANT,
+                     const Quantization& vel_q = VELOCITY_QUANT) const {
+        position.Write(w, pos_q);
+        velocity.Write(w, vel_q);
+    }
+
+    bool ReadMotion(BitReader& r, const Quantization& pos_q = POSITION_QUANT,
+                    const Quantization& vel_q = VELOCITY_QUANT) {
+        return position.Read(r, pos_q) && velocity.Read(r, vel_q);
+    }
+
+    // Binary per-field delta: a DeltaField mask, then only the changed
+    // fields. Position and velocity compare and travel quantized, so
+    // sub-precision jitter is never sent.
+    //
+    // A record names no baseline: the receiver applies it to whatever copy
+    // it holds. The sender must therefore diff against every copy the
+    // receiver may hold, not only the last acked one. If the receiver
+    // applies records in sequence order and drops late ones, those copies
+    // are the acked state and each state sent since (see PendingMask).
+    // SnapshotHistory sidesteps this by naming the base tick per message.
+    enum DeltaField : uint8_t {
+        DELTA_POSITION = 1 << 0,
+        DELTA_VELOCITY = 1 << 1,
+        DELTA_PROPERTIES = 1 << 2,
+        DELTA_NAME = 1 << 3,
+        DELTA_DESTROYED = 1 << 4,
+        DELTA_REPLACE = 1 << 5  // Properties are the full set, not changes
+    };
+    static constexpr int DELTA_MASK_BITS = 6;
+
+    static uint8_t DiffMask(const Entity& base, const Entity& current,
+                            const Quantization& pos_q = POSITION_QUANT,
+                            const Quantization& vel_q = VELOCITY_QUANT) {
+        uint8_t mask = 0;
+        if (pos_q.Quantize(base.position.x) != pos_q.Quantize(current.position.x) ||
+            pos_q.Quantize(base.position.y) != pos_q.Quantize(current.position.y)) {
+            mask |= DELTA_POSITION;
+        }
+        if (vel_q.Quantize(base.velocity.x) != vel_q.Quantize(current.velocity.x) ||
+            vel_q.Quantize(base.velocity.y) != vel_q.Quantize(current.velocity.y)) {
+            mask |= DELTA_VELOCITY;
+        }
+        if (base.properties != current.properties) mask |= DELTA_PROPERTIES;
+        if (base.id != current.id) mask |= DELTA_NAME;
+        return mask;
+    }
+
+    // Bits to add to DiffMask(base, current) for a record the receiver may
+    // apply on top of `pending`, a state sent after `base` but not yet
+    // acked. Once pending properties diverge from base, a base-relative
+    // property list cannot undo them, so properties go whole.
+    static uint8_t PendingMask(const Entity& base, const Entity& pending, const Entity& current,
+                               const Quantization& pos_q = POSITION_QUANT,
+                               const Quantization& vel_q = VELOCITY_QUANT) {
+        uint8_t mask = DiffMask(pending, current, pos_q, vel_q);
+        if (pending.properties != base.properties) mask |= DELTA_PROPERTIES | DELTA_REPLACE;
+        return mask;
+    }
+
+    static void WriteDelta(BitWriter& w, const Entity& base, const Entity& current, uint8_t mask,
+                           const Quantization& pos_q = POSITION_QUANT,
+                           const Quantization& vel_q = VELOCITY_QUANT) {
+        w.WriteBits(mask, DELTA_MASK_BITS);
+        if (mask & DELTA_DESTROYED) return;
+        if (mask & DELTA_POSITION) current.position.Write(w, pos_q);
+        if (mask & DELTA_VELOCITY) current.velocity.Write(w, vel_q);
+        if (mask & DELTA_PROPERTIES) {
+            // Changed or added keys, then removed keys
+            static const std::unordered_map<std::string, std::string> none;
+            const auto& base_props = (mask & DELTA_REPLACE) ? none : base.properties;
+            std::vector<std::pair<const std::string*, const std::string*>> changes;
+            for (const auto& [key, value] : current.properties) {
+                auto it = base_props.find(key);
+                if (it == base_props.end() || it->second != value) changes.emplace_back(&key, &value);
+            }
+            for (const auto& [key, value] : base_props) {
+                if (!current.properties.count(key)) changes.emplace_back(&key, nullptr);
+            }
+            w.WriteBits(static_cast<uint32_t>(std::min<size_t>(changes.size(), 0xFFFF)), 16);
+            for (size_t i = 0; i < changes.size() && i < 0xFFFF; i++) {
+                w.WriteString(*changes[i].first);
+                w.WriteBool(changes[i].second != nullptr);
+                if (changes[i].second) w.WriteString(*changes[i].second);
+            }
+        }
+        if (mask & DELTA_NAME) w.WriteString(current.id);
+    }
+
+    // Exact size in bits of the WriteDelta() record for `mask`
+    static size_t DeltaBits(const Entity& base, const Entity& current, uint8_t mask,
+                            const Quantization& pos_q = POSITION_QUANT,
+                            const Quantization& vel_q = VELOCITY_QUANT) {
+        size_t bits = DELTA_MASK_BITS;
+        if (mask & DELTA_DESTROYED) return bits;
+        if (mask & DELTA_POSITION) bits += 2 * pos_q.bits;
+        if (mask & DELTA_VELOCITY) bits += 2 * vel_q.bits;
+        if (mask & DELTA_PROPERTIES) {
+            static const std::unordered_map<std::string, std::string> none;
+            const auto& base_props = (mask & DELTA_REPLACE) ? none : base.properties;
+            bits += 16;
+            for (const auto& [key, value] : current.properties) {
+                auto it = base_props.find(key);
+                if (it == base_props.end() || it->second != value) bits += 33 + 8 * (key.size() + value.size());
+            }
+            for (const auto& [key, value] : base_props) {
+                if (!current.properties.count(key)) bits += 17 + 8 * key.size();
+            }
+        }
+        if (mask & DELTA_NAME) bits += 16 + 8 * current.id.size();
+        return bits;
+    }
+
+    // Applies a WriteDelta() record in place; returns the mask read, or -1
+    int ReadDelta(BitReader& r, const Quantization& pos_q = POSITION_QUANT,
+                  const Quantization& vel_q = VELOCITY_QUANT) {
+        uint32_t mask;
+        if (!r.ReadBits(mask, DELTA_MASK_BITS)) return -1;
+        if (mask & DELTA_DESTROYED) return static_cast<int>(mask);
+        if ((mask & DELTA_POSITION) && !position.Read(r, pos_q)) return -1;
+        if ((mask & DELTA_VELOCITY) && !velocity.Read(r, vel_q)) return -1;
+        if (mask & DELTA_PROPERTIES) {
+            uint32_t count;
+            if (!r.ReadBits(count, 16)) return -1;
+            if (mask & DELTA_REPLACE) properties.clear();
+            std::string key;
+            for (uint32_t i = 0; i < count; i++) {
+                bool present;
+                if (!r.ReadString(key) || !r.ReadBool(present)) return -1;
+                if (!present) {
+                    properties.erase(key);
+                } else if (!r.ReadString(properties[key])) {
+                    return -1;
+                }
+            }
+        }
+        if ((mask & DELTA_NAME) && !r.ReadString(id)) return -1;
+        return static_cast<int>(mask);
+    }
+
+    // Exact full state: handle, raw IEEE position and velocity, then a
+    // WriteDelta() record replacing name and properties. Unlike a FULL
+    // delta nothing is quantized, so a receiver that resimulates from it
+    // starts from the sender's exact floats.
+    void WriteState(BitWriter& w) const {
+        static const Entity blank;
+        w.WriteBits(handle.value, 32);
+        w.WriteFloat(position.x);
+        w.WriteFloat(position.y);
+        w.WriteFloat(velocity.x);
+        w.WriteFloat(velocity.y);
+        WriteDelta(w, blank, *this, DELTA_PROPERTIES | DELTA_NAME | DELTA_REPLACE);
+    }
+
+    bool ReadState(BitReader& r) {
+        uint32_t raw;
+        if (!r.ReadBits(raw, 32) || !r.ReadFloat(position.x) || !r.ReadFloat(position.y) ||
+            !r.ReadFloat(velocity.x) || !r.ReadFloat(velocity.y)) {
+            return false;
+        }
+        handle = EntityHandle(raw);
+        return ReadDelta(r) >= 0;
+    }
+
+    std::string Serialize() const {
+        std::stringstream ss;
+        ss << id << "|" << position.ToString() << "|" << velocity.ToString() << "|";
+        for (const auto& [key, value] : properties) {
+            ss << key << "=" << value << ";";
+        }
+        ss << "|" << handle.value;
+        return ss.str();
+    }
+
+    static Entity Deserialize(const std::string& data) {
+        Entity e;
+        std::stringstream ss(data);
+        std::string part;
+        std::vector<std::string> parts;
+
+        while (std::getline(ss, part, '|')) {
+            parts.push_back(part);
+        }
+
+        if (parts.size() >= 1) e.id = parts[0];
+        if (parts.size() >= 2) e.position = Vector2::FromString(parts[1]);
+        if (parts.size() >= 3) e.velocity = Vector2::FromString(parts[2]);
+
+        if (parts.size() >= 4) {
+            std::string props = parts[3];
+            size_t pos = 0;
+            while (pos < props.length()) {
+                size_t eq = props.find('=', pos);
+                size_t semi = props.find(';', eq);
+                if (eq == std::string::npos || semi == std::string::npos) break;
+
+                std::string key = props.substr(pos, eq - pos);
+                std::string value = props.substr(eq + 1, semi - eq - 1);
+                e.properties[key] = value;
+
+                pos = semi + 1;
+            }
+        }
+
+        uint32_t raw;
+        if (parts.size() >= 5 && CommandView::Parse(parts[4], raw)) e.handle = EntityHandle(raw);
+
+        return e;
+    }
+};
+
+// ============================================================================
+// ENTITY STORE - Structure-of-arrays storage with a SIMD integration kernel
+// ============================================================================
+
+template<typename T, size_t Align = 64>
+struct AlignedAllocator {
+    using value_type = T;
+
+    template<typename U> struct rebind { using other = AlignedAllocator<U, Align>; };
+
+    AlignedAllocator() = default;
+    template<typename U> AlignedAllocator(const AlignedAllocator<U, Align>&) {}
+
+    T* allocate(size_t n) {
+        return static_cast<T*>(::operator new(n * sizeof(T), std::align_val_t(Align)));
+    }
+
+    void deallocate(T* p, size_t) { ::operator delete(p, std::align_val_t(Align)); }
+
+    template<typename U> bool operator==(const AlignedAllocator<U, Align>&) const { return true; }
+    template<typename U> bool operator!=(const AlignedAllocator<U, Align>&) const { return false; }
+};
+
+// Positions and velocities live in separate 64-byte aligned float arrays so
+// IntegrateAll() runs as a straight SIMD loop. Ids and properties are kept
+// apart as cold data. Removal swaps the last entity into the freed index;
+// EntityHandles stay valid across that move.
+class EntityStore {
+public:
+    using Index = uint32_t;
+    static constexpr Index INVALID_INDEX = 0xFFFFFFFF;
+
+    // Lightweight accessor for one entity; invalidated by Remove()
+    class View {
+    private:
+        EntityStore* store;
+        Index index;
+
+    public:
+        View(EntityStore* s = nullptr, Index i = INVALID_INDEX) : store(s), index(i) {}
+
+        explicit operator bool() const { return store && index != INVALID_INDEX; }
+        Index GetIndex() const { return index; }
+        EntityHandle Handle() const { return store->handles[index]; }
+
+        const std::string& Id() const { return store->ids[index]; }
+        Vector2 Position() const { return Vector2(store->pos_x[index], store->pos_y[index]); }
+        Vector2 Velocity() const { return Vector2(store->vel_x[index], store->vel_y[index]); }
+
+        void SetPosition(const Vector2& p) {
+            store->pos_x[index] = p.x;
+            store->pos_y[index] = p.y;
+        }
+
+        void SetVelocity(const Vector2& v) {
+            store->vel_x[index] = v.x;
+            store->vel_y[index] = v.y;
+        }
+
+        void SetProperty(const std::string& key, const std::string& value) {
+            store->properties[index][key] = value;
+        }
+
+        std::string GetProperty(const std::string& key, const std::string& default_val = "") const {
+            const auto& props = store->properties[index];
+            auto it = props.find(key);
+            return (it != props.end()) ? it->second : default_val;
+        }
+
+        Entity ToEntity() const { return store->ToEntity(index); }
+    };
+
+private:
+    template<typename T> using AlignedVector = std::vector<T, AlignedAllocator<T>>;
+
+    AlignedVector<float> pos_x, pos_y, vel_x, vel_y;
+    std::vector<EntityHandle> handles;
+    std::vector<std::string> ids;
+    std::vector<std::unordered_map<std::string, std::string>> properties;
+    std::unordered_map<std::string, Index> index_of;  // Named entities only
+    HandleAllocator allocator;
+    std::vector<Index> dense_of;  // Handle slot -> dense index
+
+    void RemoveAt(Index index) {
+        Index last = static_cast<Index>(ids.size() - 1);
+        if (!ids[index].empty()) index_of.erase(ids[index]);
+        allocator.Release(handles[index]);
+        if (index != last) {
+            pos_x[index] = pos_x[last]; pos_y[index] = pos_y[last];
+            vel_x[index] = vel_x[last]; vel_y[index] = vel_y[last];
+            handles[index] = handles[last];
+            ids[index] = std::move(ids[last]);
+            properties[index] = std::move(properties[last]);
+            dense_of[handles[index].Index()] = index;
+            if (!ids[index].empty()) index_of[ids[index]] = index;
+        }
+        pos_x.pop_back(); pos_y.pop_back();
+        vel_x.pop_back(); vel_y.pop_back();
+        handles.pop_back();
+        ids.pop_back();
+        properties.pop_back();
+    }
+
+    // p[i] += v[i] * dt over n floats; both arrays are 64-byte aligned
+    static void Integrate(float* p, const float* v, size_t n, float dt) {
+        size_t i = 0;
+#if defined(__AVX__)
+        const __m256 step = _mm256_set1_ps(dt);
+        for (; i + 8 <= n; i += 8) {
+#if defined(__FMA__)
+            _mm256_store_ps(p + i, _mm256_fmadd_ps(_mm256_load_ps(v + i), step, _mm256_load_ps(p + i)));
+#else
+            _mm256_store_ps(p + i, _mm256_add_ps(_mm256_load_ps(p + i), _mm256_mul_ps(_mm256_load_ps(v + i), step)));
+#endif
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        const __m128 step = _mm_set1_ps(dt);
+        for (; i + 4 <= n; i += 4) {
+            _mm_store_ps(p + i, _mm_add_ps(_mm_load_ps(p + i), _mm_mul_ps(_mm_load_ps(v + i), step)));
+        }
+#endif
+        for (; i < n; i++) p[i] += v[i] * dt;
+    }
+
+public:
+    // Always creates a new entity with a fresh handle; `name` is optional
+    View Create(const std::string& name = "", const Vector2& position = Vector2(),
+                const Vector2& velocity = Vector2()) {
+        EntityHandle h = allocator.Allocate();
+        Index index = static_cast<Index>(ids.size());
+        if (h.Index() >= dense_of.size()) dense_of.resize(h.Index() + 1, INVALID_INDEX);
+        dense_of[h.Index()] = index;
+        if (!name.empty()) index_of[name] = index;
+        handles.push_back(h);
+        ids.push_back(name);
+        properties.emplace_back();
+        pos_x.push_back(position.x); pos_y.push_back(position.y);
+        vel_x.push_back(velocity.x); vel_y.push_back(velocity.y);
+        return View(this, index);
+    }
+
+    // Adds or replaces: matches e.handle first, then a non-empty e.id
+    View Add(const Entity& e) {
+        Index index = IndexOf(e.handle);
+        if (index == INVALID_INDEX && !e.id.empty()) {
+            auto it = index_of.find(e.id);
+            if (it != index_of.end()) index = it->second;
+        }
+        View view = (index == INVALID_INDEX) ? Create(e.id) : View(this, index);
+        view.SetPosition(e.position);
+        view.SetVelocity(e.velocity);
+        properties[view.GetIndex()] = e.properties;
+        return view;
+    }
+
+    // Adds or replaces the entity named `id`
+    View Add(const std::string& id, const Vector2& position = Vector2(), const Vector2& velocity = Vector2()) {
+        auto it = index_of.find(id);
+        if (it == index_of.end()) return Create(id, position, velocity);
+        View view(this, it->second);
+        properties[it->second].clear();
+        view.SetPosition(position);
+        view.SetVelocity(velocity);
+        return view;
+    }
+
+    bool Remove(EntityHandle h) {
+        Index index = IndexOf(h);
+        if (index == INVALID_INDEX) return false;
+        RemoveAt(index);
+        return true;
+    }
+
+    bool Remove(const std::string& id) {
+        auto it = index_of.find(id);
+        if (it == index_of.end()) return false;
+        RemoveAt(it->second);
+        return true;
+    }
+
+    // Falsy view for stale or unknown handles
+    View Get(EntityHandle h) {
+        Index index = IndexOf(h);
+        return (index != INVALID_INDEX) ? View(this, index) : View();
+    }
+
+    bool Contains(EntityHandle h) const { return IndexOf(h) != INVALID_INDEX; }
+
+    // Dense index for a handle, INVALID_INDEX if stale
+    Index IndexOf(EntityHandle h) const {
+        return allocator.IsAlive(h) ? dense_of[h.Index()] : INVALID_INDEX;
+    }
+
+    View Find(const std::string& id) {
+        auto it = index_of.find(id);
+        return (it != index_of.end()) ? View(this, it->second) : View();
+    }
+
+    View At(Index index) { return View(this, index); }
+
+    EntityHandle HandleAt(Index index) const { return handles[index]; }
+
+    Entity ToEntity(Index index) const {
+        Entity e(ids[index]);
+        e.handle = handles[index];
+        e.position = Vector2(pos_x[index], pos_y[index]);
+        e.velocity = Vector2(vel_x[index], vel_y[index]);
+        e.properties = properties[index];
+        return e;
+    }
+
+    void Reserve(size_t n) {
+        pos_x.reserve(n); pos_y.reserve(n);
+        vel_x.reserve(n); vel_y.reserve(n);
+        handles.reserve(n);
+        ids.reserve(n);
+        properties.reserve(n);
+    }
+
+    // Releases every handle, so handles from before Clear() stay stale
+    void Clear() {
+        for (EntityHandle h : handles) allocator.Release(h);
+        pos_x.clear(); pos_y.clear();
+        vel_x.clear(); vel_y.clear();
+        handles.clear();
+        ids.clear();
+        properties.clear();
+        index_of.clear();
+    }
+
+    size_t Size() const { return ids.size(); }
+
+    // position += velocity * dt for every entity
+    void IntegrateAll(float dt) {
+        Integrate(pos_x.data(), vel_x.data(), pos_x.size(), dt);
+        Integrate(pos_y.data(), vel_y.data(), pos_y.size(), dt);
+    }
+
+    static const char* KernelName() {
+#if defined(__AVX__)
+        return "avx";
+#elif defined(__SSE2__) || defined(_M_X64)
+        return "sse2";
+#else
+        return "scalar";
+#endif
+    }
+
+    // Raw column access for custom kernels
+    float* PositionsX() { return pos_x.data(); }
+    float* PositionsY() { return pos_y.data(); }
+    float* VelocitiesX() { return vel_x.data(); }
+    float* VelocitiesY() { return vel_y.data(); }
+    const float* PositionsX() const { return pos_x.data(); }
+    const float* PositionsY() const { return pos_y.data(); }
+    const float* VelocitiesX() const { return vel_x.data(); }
+    const float* VelocitiesY() const { return vel_y.data(); }
+    const EntityHandle* Handles() const { return handles.data(); }
+    const std::string& IdAt(Index index) const { return ids[index]; }
+    const std::unordered_map<std::string, std::string>& PropertiesAt(Index index) const { return properties[index]; }
+};
+
+// ============================================================================
+// SPATIAL GRID - Uniform hash grid over entity positions
+// ============================================================================
+
+// Entities are bucketed by cell; a move inside the same cell only rewrites
+// the stored position, and a cell change is two swap-removes/appends, so
+// maintaining tens of thousands of moving entities stays O(moved).
+// Pick cell_size near the typical query radius.
+class SpatialGrid {
+private:
+    struct Item {
+        EntityHandle handle;
+        float x = 0, y = 0;
+        uint64_t cell = 0;
+        uint32_t slot = 0;    // Position in the cell's bucket
+        uint32_t stamp = 0;   // Last Sync() that saw this entity
+    };
+
+    float cell_size;
+    float inv_cell;
+    std::vector<Item> items;  // By handle index
+    std::unordered_map<uint64_t, std::vector<EntityHandle>> cells;
+    size_t count;
+    uint32_t sync_stamp;
+
+    // NaN, infinite and far out-of-range positions are clamped into
+    // range before the cast, which would otherwise be undefined
+    int32_t CellCoord(float v) const {
+        constexpr float LIMIT = 1e9f;
+        float f = v * inv_cell;
+        if (!(f == f)) f = 0;
+        f = std::max(-LIMIT, std::min(LIMIT, f));
+        int32_t i = static_cast<int32_t>(f);
+        return i - (f < static_cast<float>(i));  // floor without a libm call
+    }
+
+    static uint64_t CellKey(int32_t cx, int32_t cy) {
+        return (static_cast<uint64_t>(static_cast<uint32_t>(cx)) << 32) | static_cast<uint32_t>(cy);
+    }
+
+    Item* Lookup(EntityHandle h) {
+        if (!h || h.Index() >= items.size() || items[h.Index()].handle != h) return nullptr;
+        return &items[h.Index()];
+    }
+
+    void Unlink(const Item& item) {
+        auto it = cells.find(item.cell);
+        std::vector<EntityHandle>& bucket = it->second;
+        EntityHandle moved = bucket.back();
+        bucket[item.slot] = moved;
+        items[moved.Index()].slot = item.slot;
+        bucket.pop_back();
+        if (bucket.empty()) cells.erase(it);
+    }
+
+    void Link(Item& item) {
+        std::vector<EntityHandle>& bucket = cells[item.cell];
+        item.slot = static_cast<uint32_t>(bucket.size());
+        bucket.push_back(item.handle);
+    }
+
+    template<typename F>
+    void ForEachInBox(float min_x, float min_y, float max_x, float max_y, F&& f) const {
+        int32_t x0 = CellCoord(min_x), x1 = CellCoord(max_x);
+        int32_t y0 = CellCoord(min_y), y1 = CellCoord(max_y);
+        uint64_t span = static_cast<uint64_t>(static_cast<int64_t>(x1) - x0 + 1) *
+                        static_cast<uint64_t>(static_cast<int64_t>(y1) - y0 + 1);
+        if (span > cells.size()) {
+            // Query covers more cells than are occupied: walk occupied ones
+            for (const auto& [key, bucket] : cells) {
+                for (EntityHandle h : bucket) f(items[h.Index()]);
+            }
+            return;
+        }
+        for (int32_t cx = x0; cx <= x1; cx++) {
+            for (int32_t cy = y0; cy <= y1; cy++) {
+                auto it = cells.find(CellKey(cx, cy));
+                if (it == cells.end()) continue;
+                for (EntityHandle h : it->second) f(items[h.Index()]);
+            }
+        }
+    }
+
+public:
+    explicit SpatialGrid(float cell = 64.0f)
+        : cell_size(cell > 0 ? cell : 64.0f), inv_cell(1.0f / cell_size), count(0), sync_stamp(0) {}
+
+    // Inserts or moves an entity
+    void Update(EntityHandle h, const Vector2& position) {
+        if (!h) return;
+        uint64_t cell = CellKey(CellCoord(position.x), CellCoord(position.y));
+        Item* item = Lookup(h);
+        if (!item) {
+            if (h.Index() >= items.size()) items.resize(h.Index() + 1);
+            item = &items[h.Index()];
+            if (item->handle) Remove(item->handle);  // Older generation still indexed
+            item->handle = h;
+            item->cell = cell;
+            Link(*item);
+            count++;
+        } else if (item->cell != cell) {
+            Unlink(*item);
+            item->cell = cell;
+            Link(*item);
+        }
+        item->x = position.x;
+        item->y = position.y;
+        item->stamp = sync_stamp;
+    }
+
+    bool Remove(EntityHandle h) {
+        Item* item = Lookup(h);
+        if (!item) return false;
+        Unlink(*item);
+        item->handle = EntityHandle();
+        count--;
+        return true;
+    }
+
+    // Mirrors `store`: updates every entity and drops those no longer in it
+    void Sync(const EntityStore& store) {
+        sync_stamp++;
+        const float* xs = store.PositionsX();
+        const float* ys = store.PositionsY();
+        for (EntityStore::Index i = 0; i < store.Size(); i++) {
+            Update(store.HandleAt(i), Vector2(xs[i], ys[i]));
+        }
+        if (count == store.Size()) return;
+        for (Item& item : items) {
+            if (item.handle && item.stamp != sync_stamp) Remove(item.handle);
+        }
+    }
+
+    // Appends handles within `radius` of `center` to `out`
+    void QueryRadius(const Vector2& center, float radius, std::vector<EntityHandle>& out) const {
+        float r2 = radius * radius;
+        ForEachInBox(center.x - radius, center.y - radius, center.x + radius, center.y + radius,
+                     [&](const Item& item) {
+                         float dx = item.x - center.x, dy = item.y - center.y;
+                         if (dx * dx + dy * dy <= r2) out.push_back(item.handle);
+                     });
+    }
+
+    // Appends handles inside the box [min, max] to `out`
+    void QueryAABB(const Vector2& min, const Vector2& max, std::vector<EntityHandle>& out) const {
+        ForEachInBox(min.x, min.y, max.x, max.y, [&](const Item& item) {
+            if (item.x >= min.x && item.x <= max.x && item.y >= min.y && item.y <= max.y) {
+                out.push_back(item.handle);
+            }
+        });
+    }
+
+    std::vector<EntityHandle> QueryRadius(const Vector2& center, float radius) const {
+        std::vector<EntityHandle> out;
+        QueryRadius(center, radius, out);
+        return out;
+    }
+
+    std::vector<EntityHandle> QueryAABB(const Vector2& min, const Vector2& max) const {
+        std::vector<EntityHandle> out;
+        QueryAABB(min, max, out);
+        return out;
+    }
+
+    bool Contains(EntityHandle h) const { return const_cast<SpatialGrid*>(this)->Lookup(h) != nullptr; }
+    size_t Size() const { return count; }
+    float GetCellSize() const { return cell_size; }
+
+    void Clear() {
+        items.clear();
+        cells.clear();
+        count = 0;
+    }
+};
+
+// ============================================================================
+// SNAPSHOTS - Tick-indexed world history for acked-baseline delta compression
+// ============================================================================
+
+// One world snapshot in compact form. Entities are handle-sorted columns:
+// motion quantized with POSITION_QUANT / VELOCITY_QUANT (16 bytes), and
+// name plus sorted properties packed into `extras` (nothing for plain
+// entities). `state` holds the GameState values at the snapshot's tick and
+// is shared with neighbouring snapshots while the state is unchanged.
+struct Snapshot {
+    using StateValues = std::vector<std::pair<std::string, std::string>>;  // Sorted by key
+
+    uint32_t tick = 0;
+    uint32_t state_version = 0;
+    std::shared_ptr<const StateValues> state;
+    std::vector<EntityHandle> handles;
+    std::vector<uint32_t> motion;     // x, y, vx, vy per entity
+    std::vector<uint32_t> extra_end;  // End of each entity's record in `extras`
+    std::vector<uint8_t> extras;
+    bool valid = false;
+
+    size_t Size() const { return handles.size(); }
+
+    // Index of `h`, or Size() if the snapshot does not hold it
+    size_t IndexOf(EntityHandle h) const {
+        auto it = std::lower_bound(handles.begin(), handles.end(), h);
+        return (it != handles.end() && *it == h) ? static_cast<size_t>(it - handles.begin()) : Size();
+    }
+
+    // Entities must be appended in handle order
+    void Append(EntityHandle h, const Vector2& position, const Vector2& velocity, const std::string& id,
+                const std::unordered_map<std::string, std::string>& properties) {
+        handles.push_back(h);
+        motion.push_back(POSITION_QUANT.Quantize(position.x));
+        motion.push_back(POSITION_QUANT.Quantize(position.y));
+        motion.push_back(VELOCITY_QUANT.Quantize(velocity.x));
+        motion.push_back(VELOCITY_QUANT.Quantize(velocity.y));
+        if (!id.empty() || !properties.empty()) {
+            std::vector<const std::pair<const std::string, std::string>*> sorted;
+            sorted.reserve(properties.size());
+            for (const auto& kv : properties) sorted.push_back(&kv);
+            std::sort(sorted.begin(), sorted.end(), [](const auto* a, const auto* b) { return a->first < b->first; });
+
+            BitWriter w(extras);
+            w.WriteString(id);
+            w.WriteBits(static_cast<uint32_t>(std::min<size_t>(sorted.size(), 0xFFFF)), 16);
+            for (size_t i = 0; i < sorted.size() && i < 0xFFFF; i++) {
+                w.WriteString(sorted[i]->first);
+                w.WriteString(sorted[i]->second);
+            }
+        }
+        extra_end.push_back(static_cast<uint32_t>(extras.size()));
+    }
+
+    void Append(const Entity& e) { Append(e.handle, e.position, e.velocity, e.id, e.properties); }
+
+    Entity At(size_t i) const {
+        Entity e;
+        e.handle = handles[i];
+        e.position = Vector2(POSITION_QUANT.Dequantize(motion[4 * i]), POSITION_QUANT.Dequantize(motion[4 * i + 1]));
+        e.velocity = Vector2(VELOCITY_QUANT.Dequantize(motion[4 * i + 2]), VELOCITY_QUANT.Dequantize(motion[4 * i + 3]));
+        size_t begin = i ? extra_end[i - 1] : 0;
+        if (extra_end[i] > begin) {
+            BitReader r(extras.data() + begin, extra_end[i] - begin);
+            uint32_t count = 0;
+            r.ReadString(e.id);
+            r.ReadBits(count, 16);
+            std::string key;
+            for (uint32_t k = 0; k < count && r.ReadString(key); k++) r.ReadString(e.properties[key]);
+        }
+        return e;
+    }
+
+    // Whether entity `i` here and entity `j` in `other` encode identically
+    bool Same(size_t i, const Snapshot& other, size_t j) const {
+        if (!std::equal(motion.begin() + 4 * i, motion.begin() + 4 * i + 4, other.motion.begin() + 4 * j)) return false;
+        size_t a = i ? extra_end[i - 1] : 0, b = j ? other.extra_end[j - 1] : 0;
+        return extra_end[i] - a == other.extra_end[j] - b &&
+               std::equal(extras.begin() + a, extras.begin() + extra_end[i], other.extras.begin() + b);
+    }
+
+    size_t MemoryBytes() const {
+        return handles.size() * sizeof(EntityHandle) + (motion.size() + extra_end.size()) * sizeof(uint32_t) +
+               extras.size();
+    }
+};
+
+// Ring buffer of world snapshots by tick plus the last snapshot each client
+// acknowledged. Delta() diffs the newest snapshot against that client's
+// acked baseline, GameState included, and falls back to a full snapshot
+// once the baseline has been overwritten.
+//
+// Message: "SNAP|<tick>|<base tick, 0 = full>" followed by lines
+//   F<GameState::Serialize()>   S<GameState::SerializeDelta()>
+//   E<Entity::Serialize()>      D<entity handle>
+class SnapshotHistory {
+private:
+    static constexpr size_t NONE = ~static_cast<size_t>(0);
+
+    std::vector<Snapshot> ring;
+    std::unordered_map<std::string, uint32_t> acked;
+    uint32_t latest_tick;
+
+    // Merge walk over two snapshots' handles: f(old index, new index) with
+    // NONE for a created (old) or destroyed (new) entity
+    template<typename F>
+    static void Diff(const Snapshot* base, const Snapshot& current, F&& f) {
+        size_t n = base ? base->Size() : 0;
+        size_t i = 0, j = 0;
+        while (i < n || j < current.Size()) {
+            if (j == current.Size() || (i < n && base->handles[i] < current.handles[j])) {
+                f(i++, NONE);
+            } else if (i == n || current.handles[j] < base->handles[i]) {
+                f(NONE, j++);
+            } else {
+                f(i++, j++);
+            }
+        }
+    }
+
+    // Values are shared with the newest snapshot while the version matches
+    std::shared_ptr<const Snapshot::StateValues> CaptureState(const GameState& state) const {
+        const Snapshot* last = Find(latest_tick);
+        if (last && last->state && last->state_version == state.GetVersion()) return last->state;
+
+        auto values = std::make_shared<Snapshot::StateValues>();
+        const std::string& text = state.SerializeCached();
+        size_t pos = text.find('|');
+        pos = (pos == std::string::npos) ? text.size() : pos + 1;
+        while (pos < text.size()) {
+            size_t eq = text.find('=', pos);
+            size_t semi = text.find(';', eq);
+            if (eq == std::string::npos || semi == std::string::npos) break;
+            values->emplace_back(text.substr(pos, eq - pos), text.substr(eq + 1, semi - eq - 1));
+            pos = semi + 1;
+        }
+        std::sort(values->begin(), values->end());
+        return values;
+    }
+
+    // "since|version|key=value;..." for keys whose captured value differs
+    static std::string StateDelta(const Snapshot& base, const Snapshot& current) {
+        std::string out = std::to_string(base.state_version) + "|" + std::to_string(current.state_version) + "|";
+        if (!current.state || base.state == current.state) return out;
+        static const Snapshot::StateValues none;
+        const Snapshot::StateValues& old_values = base.state ? *base.state : none;
+        size_t i = 0;
+        for (const auto& [key, value] : *current.state) {
+            while (i < old_values.size() && old_values[i].first < key) i++;
+            if (i < old_values.size() && old_values[i].first == key && old_values[i].second == value) continue;
+            out.append(key).append("=").append(value).append(";");
+        }
+        return out;
+    }
+
+    static std::string StateFull(const Snapshot& snap) {
+        std::string out = std::to_string(snap.state_version) + "|";
+        if (snap.state) {
+            for (const auto& [key, value] : *snap.state) out.append(key).append("=").append(value).append(";");
+        }
+        return out;
+    }
+
+    static Snapshot Build(uint32_t tick, std::vector<Entity>& entities) {
+        std::sort(entities.begin(), entities.end(),
+                  [](const Entity& a, const Entity& b) { return a.handle < b.handle; });
+        Snapshot snap;
+        snap.tick = tick;
+        snap.handles.reserve(entities.size());
+        snap.motion.reserve(entities.size() * 4);
+        snap.extra_end.reserve(entities.size());
+        for (const Entity& e : entities) snap.Append(e);
+        return snap;
+    }
+
+    // Decoded copy of a stored baseline for the client-side Apply paths
+    static std::vector<Entity> Expand(const Snapshot* base) {
+        std::vector<Entity> out;
+        if (!base) return out;
+        out.reserve(base->Size());
+        for (size_t i = 0; i < base->Size(); i++) out.push_back(base->At(i));
+        return out;
+    }
+
+    static std::vector<Entity>::iterator Locate(std::vector<Entity>& entities, EntityHandle h) {
+        return std::lower_bound(entities.begin(), entities.end(), h,
+                                [](const Entity& a, EntityHandle id) { return a.handle < id; });
+    }
+
+public:
+    explicit SnapshotHistory(size_t capacity = 64) : ring(std::max<size_t>(capacity, 1)), latest_tick(0) {}
+
+    const Snapshot& Store(Snapshot snap) {
+        Snapshot& slot = ring[snap.tick % ring.size()];
+        slot = std::move(snap);
+        slot.valid = true;
+        if (slot.tick > latest_tick) latest_tick = slot.tick;
+        return slot;
+    }
+
+    const Snapshot& Capture(uint32_t tick, const GameState& state, const EntityStore& entities) {
+        std::vector<EntityStore::Index> order(entities.Size());
+        for (EntityStore::Index i = 0; i < entities.Size(); i++) order[i] = i;
+        const EntityHandle* handles = entities.Handles();
+        std::sort(order.begin(), order.end(), [&](EntityStore::Index a, EntityStore::Index b) {
+            return handles[a] < handles[b];
+        });
+
+        Snapshot snap;
+        snap.tick = tick;
+        snap.state_version = state.GetVersion();
+        snap.state = CaptureState(state);
+        snap.handles.reserve(order.size());
+        snap.motion.reserve(order.size() * 4);
+        snap.extra_end.reserve(order.size());
+        const float* px = entities.PositionsX();
+        const float* py = entities.PositionsY();
+        const float* vx = entities.VelocitiesX();
+        const float* vy = entities.VelocitiesY();
+        for (EntityStore::Index i : order) {
+            snap.Append(handles[i], Vector2(px[i], py[i]), Vector2(vx[i], vy[i]), entities.IdAt(i),
+                        entities.PropertiesAt(i));
+        }
+        return Store(std::move(snap));
+    }
+
+    // Entities must carry handles (e.g. from a HandleAllocator)
+    const Snapshot& Capture(uint32_t tick, const GameState& state, std::vector<Entity> entities) {
+        Snapshot snap = Build(tick, entities);
+        snap.state_version = state.GetVersion();
+        snap.state = CaptureState(state);
+        return Store(std::move(snap));
+    }
+
+    // nullptr once the tick has aged out of the ring
+    const Snapshot* Find(uint32_t tick) const {
+        const Snapshot& slot = ring[tick % ring.size()];
+        return (slot.valid && slot.tick == tick) ? &slot : nullptr;
+    }
+
+    uint32_t GetLatestTick() const { return latest_tick; }
+
+    size_t MemoryBytes() const {
+        size_t total = 0;
+        for (const Snapshot& s : ring) total += s.MemoryBytes();
+        return total;
+    }
+
+    void Ack(const std::string& client, uint32_t tick) {
+        uint32_t& last = acked[client];
+        if (tick > last && tick <= latest_tick) last = tick;
+    }
+
+    uint32_t GetAcked(const std::string& client) const {
+        auto it = acked.find(client);
+        return (it != acked.end()) ? it->second : 0;
+    }
+
+    void RemoveClient(const std::string& client) { acked.erase(client); }
+
+    // Newest snapshot encoded against `client`'s acked baseline. GameState
+    // values come from the two snapshots, not from the live state.
+    std::string Delta(const std::string& client) const {
+        const Snapshot* current = Find(latest_tick);
+        if (!current) return "";
+        uint32_t base_tick = GetAcked(client);
+        const Snapshot* base = (base_tick != 0) ? Find(base_tick) : nullptr;
+
+        std::stringstream ss;
+        ss << "SNAP|" << current->tick << "|" << (base ? base->tick : 0) << "\n";
+        if (base) {
+            ss << "S" << StateDelta(*base, *current) << "\n";
+        } else {
+            ss << "F" << StateFull(*current) << "\n";
+        }
+
+        Diff(base, *current, [&](size_t i, size_t j) {
+            if (j == NONE) ss << "D" << base->handles[i].value << "\n";
+            else if (i == NONE || !base->Same(i, *current, j)) ss << "E" << current->At(j).Serialize() << "\n";
+        });
+        return ss.str();
+    }
+
+    // Binary entity-only form of Delta(): MagicWords::ENTITY_UPDATE command
+    // whose argument is a bit stream of a set snapshot bit, tick, base tick,
+    // then per entity a continuation bit, the handle and an
+    // Entity::WriteDelta() record. GameState still travels as text
+    // STATE_DELTA.
+    std::vector<uint8_t> DeltaBinary(const std::string& client) const {
+        std::vector<uint8_t> out;
+        const Snapshot* current = Find(latest_tick);
+        if (!current) return out;
+        uint32_t base_tick = GetAcked(client);
+        const Snapshot* base = (base_tick != 0) ? Find(base_tick) : nullptr;
+
+        std::string_view code = MagicWords::Lookup(MagicWords::ENTITY_UPDATE);
+        out.assign(code.begin(), code.end());
+        out.push_back(CommandView::BINARY_MARK);
+
+        BitWriter w(out);
+        w.WriteBool(true);
+        w.WriteBits(current->tick, 32);
+        w.WriteBits(base ? base->tick : 0, 32);
+        static const Entity blank;
+        Diff(base, *current, [&](size_t i, size_t j) {
+            if (i != NONE && j != NONE && base->Same(i, *current, j)) return;
+            w.WriteBool(true);
+            if (j == NONE) {
+                w.WriteBits(base->handles[i].value, 32);
+                Entity::WriteDelta(w, blank, blank, Entity::DELTA_DESTROYED);
+                return;
+            }
+            Entity old_e = (i != NONE) ? base->At(i) : blank;
+            Entity new_e = current->At(j);
+            w.WriteBits(new_e.handle.value, 32);
+            Entity::WriteDelta(w, old_e, new_e, Entity::DiffMask(old_e, new_e));  // New entities are sent even when blank
+        });
+        w.WriteBool(false);
+        w.Flush();
+        return out;
+    }
+
+    // Rebuilds a DeltaBinary() snapshot (the bytes after the command code
+    // and mark) on top of the stored baseline, like Apply().
+    const Snapshot* ApplyBinary(const uint8_t* data, size_t len) {
+        BitReader r(data, len);
+        bool is_snapshot;
+        uint32_t tick, base_tick;
+        if (!r.ReadBool(is_snapshot) || !is_snapshot) return nullptr;
+        if (!r.ReadBits(tick, 32) || !r.ReadBits(base_tick, 32)) return nullptr;
+
+        const Snapshot* base = nullptr;
+        if (base_tick != 0 && !(base = Find(base_tick))) return nullptr;
+        std::vector<Entity> entities = Expand(base);
+
+        bool more;
+        uint32_t raw;
+        while (r.ReadBool(more) && more) {
+            if (!r.ReadBits(raw, 32)) return nullptr;
+            EntityHandle h(raw);
+            auto it = Locate(entities, h);
+            bool found = it != entities.end() && it->handle == h;
+            if (!found) {
+                it = entities.insert(it, Entity());
+                it->handle = h;
+            }
+            int mask = it->ReadDelta(r);
+            if (mask < 0) return nullptr;
+            if (mask & Entity::DELTA_DESTROYED) entities.erase(it);
+        }
+        if (!r.Ok()) return nullptr;
+        Snapshot snap = Build(tick, entities);
+        if (base) snap.state_version = base->state_version;
+        return &Store(std::move(snap));
+    }
+
+    // Rebuilds the snapshot described by a Delta() body ("<tick>|<base>\n...")
+    // on top of the stored baseline and stores it. Returns nullptr if the
+    // baseline is not held here.
+    const Snapshot* Apply(const std::string& data, GameState& state) {
+        std::stringstream ss(data);
+        std::string header, line;
+        std::getline(ss, header);
+        size_t pipe = header.find('|');
+        uint32_t tick, base_tick;
+        if (pipe == std::string::npos ||
+            !CommandView::Parse(std::string_view(header).substr(0, pipe), tick) ||
+            !CommandView::Parse(std::string_view(header).substr(pipe + 1), base_tick)) {
+            return nullptr;
+        }
+
+        const Snapshot* base = nullptr;
+        if (base_tick != 0 && !(base = Find(base_tick))) return nullptr;
+        std::vector<Entity> entities = Expand(base);
+
+        bool newest = tick > latest_tick;
+        while (std::getline(ss, line)) {
+            if (line.empty()) continue;
+            std::string body = line.substr(1);
+            switch (line[0]) {
+                case 'F':
+                    if (newest) state.Deserialize(body);
+                    break;
+                case 'S':
+                    state.ApplyDelta(body);
+                    break;
+                case 'E': {
+                    Entity e = Entity::Deserialize(body);
+                    if (!e.handle) break;
+                    auto it = Locate(entities, e.handle);
+                    if (it != entities.end() && it->handle == e.handle) *it = std::move(e);
+                    else entities.insert(it, std::move(e));
+                    break;
+                }
+                case 'D': {
+                    uint32_t raw;
+                    if (!CommandView::Parse(body, raw)) break;
+                    auto it = Locate(entities, EntityHandle(raw));
+                    if (it != entities.end() && it->handle == EntityHandle(raw)) entities.erase(it);
+                    break;
+                }
+            }
+        }
+        Snapshot snap = Build(tick, entities);
+        snap.state_version = state.GetVersion();
+        return &Store(std::move(snap));
+    }
+};
+
+// ============================================================================
+// INTEREST MANAGEMENT - Per-client relevance sets
+// ============================================================================
+
+// Each client sees only entities near its focus point. Update() recomputes
+// the client's relevant set from a SpatialGrid query and produces binary
+// commands: ENTITY_CREATE for entities entering the set, ENTITY_DESTROY for
+// those leaving it, and ENTITY_UPDATE (snapshot bit clear) with per-field
+// deltas. Entities leave only beyond radius * hysteresis, so set edges
+// don't flap.
+//
+// Every command carries a sequence number that the client acks with
+// "ENTITY_ACK|seq;...". Deltas are against the state the client last acked,
+// like SnapshotHistory baselines, so a lost update is repeated until one
+// gets through, and creates and destroys are resent on every Update() until
+// acked. Since the client applies each delta to its newest copy, a delta
+// also carries every field that differs from a state sent since the ack
+// (Entity::PendingMask). Every refresh_ticks updates an entity's full state is resent
+// (properties replaced wholesale) as a backstop. Output is split into
+// messages of at most max_message_bytes.
+//
+// With a byte budget set, pending creates and updates accrue priority each
+// tick they wait (nearer and faster entities accrue faster) and each
+// Update() sends the highest-priority records that fit. Deferred records
+// are never dropped; they go out, complete, on a later tick.
+class InterestManager {
+public:
+    static constexpr size_t DEFAULT_MESSAGE_BYTES = 1200;  // Fits a typical MTU
+    static constexpr size_t MAX_IN_FLIGHT = 256;           // Unacked messages tracked per client
+    static constexpr size_t MAX_PENDING_STATES = 16;       // Unacked states kept per entity
+
+    struct Changes {
+        std::vector<EntityHandle> entered;
+        std::vector<EntityHandle> left;
+        size_t updated = 0;
+        size_t deferred = 0;
+        size_t bytes = 0;
+    };
+
+    struct PriorityWeights {
+        float distance = 1.0f;   // Extra weight at the focus, fading to 0 at the radius
+        float velocity = 0.01f;  // Extra weight per unit of speed
+        float create = 2.0f;     // Multiplier for entities not yet created on the client
+    };
+
+private:
+    enum class RecordKind : uint8_t { CREATE, UPDATE, DESTROY };
+
+    // A state sent in message `seq`, not yet acked
+    struct Pending {
+        uint32_t seq;
+        Entity state;
+    };
+
+    struct Tracked {
+        EntityHandle handle;
+        Entity acked;               // Client's state as of the newest acked record
+        uint32_t acked_seq = 0;
+        std::vector<Pending> pending;  // Ascending seq, all newer than acked_seq
+        uint32_t forgotten = 0;     // Newest pending seq dropped; full records until acked past it
+        uint32_t epoch = 0;         // Acks of messages older than this are stale
+        uint32_t refreshed_at = 0;  // Update count of the last full record
+        float priority = 0;
+        bool relevant = true;       // false: destroy pending until acked
+        bool created = false;       // A create was acked
+        bool create_sent = false;   // A create went out this epoch
+    };
+
+    struct SentRecord {
+        EntityHandle handle;
+        RecordKind kind;
+    };
+
+    struct InFlight {
+        uint32_t seq;
+        std::vector<SentRecord> records;
+    };
+
+    struct ClientView {
+        Vector2 focus;
+        float radius = 0;
+        size_t budget = 0;  // Bytes per Update(); 0 = unlimited
+        uint32_t updates = 0;
+        uint32_t next_seq = 1;
+        std::vector<Tracked> tracked;    // Sorted by handle
+        std::deque<InFlight> in_flight;  // Ascending seq
+        Changes changes;
+    };
+
+    struct Candidate {
+        float priority;
+        size_t bits;
+        uint8_t mask;
+        size_t slot;  // Into the tracked set being built
+    };
 
-                    auto seen = Packet::MakeSeen(pkt.seq);
-                    socket.Send(seen.Serialize(), from_host, from_port);
+    // One command kind's output, cut into messages as they fill
+    struct Stream {
+        const std::string& word;
+        std::optional<uint32_t> tick;
+        std::vector<uint8_t> data;
+        std::unique_ptr<BitWriter> w;
+        size_t bits = 0;
+        InFlight* flight = nullptr;
 
-                    if (handler) {
-                        handler(pkt, from_host, from_port);
-                    }
-                }
+        Stream(const std::string& command, std::optional<uint32_t> server_tick) : word(command), tick(server_tick) {}
+    };
 
-                return true;
-            } catch (...) {}
+    using Output = std::vector<std::pair<uint32_t, std::vector<uint8_t>>>;
+
+    static constexpr uint8_t FULL_MASK = Entity::DELTA_POSITION | Entity::DELTA_VELOCITY |
+                                         Entity::DELTA_PROPERTIES | Entity::DELTA_NAME | Entity::DELTA_REPLACE;
+
+    std::unordered_map<std::string, ClientView> clients;
+    float default_radius;
+    float hysteresis;
+    uint32_t refresh_ticks;
+    size_t default_budget;
+    size_t max_message_bytes;
+    PriorityWeights weights;
+    std::vector<EntityHandle> scratch;
+
+    void Finish(Stream& s, ClientView& view, Output& out) {
+        if (!s.w) return;
+        s.w->WriteBool(false);
+        s.w.reset();
+        view.changes.bytes += s.data.size();
+        out.emplace_back(s.flight->seq, std::move(s.data));
+        s.data.clear();
+        s.flight = nullptr;
+    }
+
+    // Opens a message if needed (closing a full one first) and marks one more record
+    BitWriter& Begin(Stream& s, ClientView& view, size_t record_bits, Output& out) {
+        if (s.w && s.bits + 1 + record_bits + 1 > max_message_bytes * 8) Finish(s, view, out);
+        if (!s.w) {
+            std::string_view code = MagicWords::Lookup(s.word);
+            s.data.assign(code.begin(), code.end());
+            s.data.push_back(CommandView::BINARY_MARK);
+            s.w.reset(new BitWriter(s.data));
+            s.bits = s.data.size() * 8 + 32;
+            if (s.word == MagicWords::ENTITY_UPDATE) {
+                s.w->WriteBool(false);  // Not a snapshot
+                s.bits++;
+            }
+            view.in_flight.push_back({view.next_seq++, {}});
+            s.flight = &view.in_flight.back();
+            s.w->WriteBits(s.flight->seq, 32);
+            if (s.word != MagicWords::ENTITY_DESTROY) {
+                // Places motion samples on the server timeline
+                s.w->WriteBool(s.tick.has_value());
+                if (s.tick) s.w->WriteBits(*s.tick, 32);
+                s.bits += s.tick ? 33 : 1;
+            }
         }
+        s.w->WriteBool(true);
+        s.bits += 1 + record_bits;
+        return *s.w;
+    }
 
-        fragment_mgr.CleanupStale();
-        return false;
+    ClientView& View(const std::string& client) {
+        ClientView& view = clients[client];
+        if (view.radius == 0) {
+            view.radius = default_radius;
+            view.budget = default_budget;
+        }
+        return view;
     }
 
-    void SendTo(const std::vector<uint8_t>& data, const std::string& host, uint16_t port) {
-        auto pkt = Packet::MakeGive(0, {}, data);
-        socket.Send(pkt.Serialize(), host, port);
+    static std::vector<Tracked>::iterator Locate(std::vector<Tracked>& tracked, EntityHandle h) {
+        return std::lower_bound(tracked.begin(), tracked.end(), h,
+                                [](const Tracked& a, EntityHandle id) { return a.handle < id; });
     }
 
-    void SendTo(const std::string& text, const std::string& host, uint16_t port) {
-        std::vector<uint8_t> data(text.begin(), text.end());
-        SendTo(data, host, port);
+    float Weight(const ClientView& view, const Entity& e) const {
+        float dx = e.position.x - view.focus.x, dy = e.position.y - view.focus.y;
+        float closeness = std::max(0.0f, 1.0f - std::sqrt(dx * dx + dy * dy) / view.radius);
+        return (1.0f + weights.distance * closeness) * (1.0f + weights.velocity * e.velocity.Length());
     }
 
-    void Broadcast(const std::vector<uint8_t>& data) {
-        for (const auto& [key, client] : clients) {
-            SendTo(data, client.host, client.port);
+public:
+    explicit InterestManager(float radius = 500.0f, float hysteresis_factor = 1.1f, uint32_t refresh = 30)
+        : default_radius(radius), hysteresis(std::max(1.0f, hysteresis_factor)),
+          refresh_ticks(std::max<uint32_t>(refresh, 1)), default_budget(0),
+          max_message_bytes(DEFAULT_MESSAGE_BYTES) {}
+
+    // Adds the client on first use
+    void SetFocus(const std::string& client, const Vector2& focus) { View(client).focus = focus; }
+    void SetRadius(const std::string& client, float radius) { View(client).radius = radius; }
+
+    // Entity bytes per Update() for one client (0 = unlimited); the single
+    // highest-priority record is always sent so oversized ones still progress
+    void SetBudget(const std::string& client, size_t bytes) { View(client).budget = bytes; }
+    void SetDefaultBudget(size_t bytes) { default_budget = bytes; }
+    void SetPriorityWeights(const PriorityWeights& w) { weights = w; }
+
+    // Largest message Update() builds; a single record bigger than this
+    // still goes out alone
+    void SetMaxMessageSize(size_t bytes) { max_message_bytes = std::max<size_t>(bytes, 64); }
+
+    void RemoveClient(const std::string& client) { clients.erase(client); }
+
+    // Records that `client` received message `seq`
+    void Ack(const std::string& client, uint32_t seq) {
+        auto it = clients.find(client);
+        if (it == clients.end()) return;
+        ClientView& view = it->second;
+        auto flight = std::lower_bound(view.in_flight.begin(), view.in_flight.end(), seq,
+                                       [](const InFlight& f, uint32_t s) { return f.seq < s; });
+        if (flight == view.in_flight.end() || flight->seq != seq) return;
+
+        for (SentRecord& r : flight->records) {
+            auto t = Locate(view.tracked, r.handle);
+            if (t == view.tracked.end() || t->handle != r.handle || seq < t->epoch) continue;
+            if (r.kind == RecordKind::DESTROY) {
+                if (!t->relevant) view.tracked.erase(t);
+                continue;
+            }
+            if (!t->relevant || (t->created && seq <= t->acked_seq)) continue;
+            auto p = std::find_if(t->pending.begin(), t->pending.end(),
+                                  [seq](const Pending& x) { return x.seq == seq; });
+            if (p == t->pending.end()) continue;  // Forgotten; records stay full
+            t->acked = std::move(p->state);
+            t->acked_seq = seq;
+            t->created = true;
+            // The client applies in order, so it can no longer hold older states
+            t->pending.erase(t->pending.begin(), p + 1);
         }
+        view.in_flight.erase(flight);
     }
 
-    void Broadcast(const std::string& text) {
-        std::vector<uint8_t> data(text.begin(), text.end());
-        Broadcast(data);
+    // "ENTITY_ACK|seq;seq;..." as sent by GameClient
+    void Ack(const std::string& client, const CommandView& cmd) {
+        for (std::string_view token : cmd) {
+            uint32_t seq;
+            if (CommandView::Parse(token, seq)) Ack(client, seq);
+        }
     }
 
-    int GetClientCount() const { return clients.size(); }
-    bool IsRunning() const { return running; }
-};
+    bool IsRelevant(const std::string& client, EntityHandle h) const {
+        auto it = clients.find(client);
+        if (it == clients.end()) return false;
+        const auto& tracked = it->second.tracked;
+        auto t = std::lower_bound(tracked.begin(), tracked.end(), h,
+                                  [](const Tracked& a, EntityHandle id) { return a.handle < id; });
+        return t != tracked.end() && t->handle == h && t->relevant;
+    }
 
-} // namespace HERO
+    size_t GetRelevantCount(const std::string& client) const {
+        auto it = clients.find(client);
+        if (it == clients.end()) return 0;
+        size_t n = 0;
+        for (const Tracked& t : it->second.tracked) n += t.relevant;
+        return n;
+    }
 
-#endif // HERO_H
+    // Recomputes `client`'s relevant set and appends its create, destroy
+    // and update commands to `messages`, in sequence order. `tick` is the
+    // server tick (HeroServer::GetTick) the store's state belongs to; any
+    // value, 0 included, is sent. Without one clients stamp on arrival.
+    const Changes& Update(const std::string& client, const SpatialGrid& grid, const EntityStore& store,
+                          std::vector<std::vector<uint8_t>>& messages,
+                          std::optional<uint32_t> tick = std::nullopt) {
+        ClientView& view = View(client);
+        view.updates++;
+        view.changes = Changes();
+
+        scratch.clear();
+        grid.QueryRadius(view.focus, view.radius * hysteresis, scratch);
+        std::sort(scratch.begin(), scratch.end());
+
+        std::vector<Tracked> next;
+        std::vector<Entity> current;  // Parallel to `next`: state to send
+        std::vector<Candidate> candidates;
+        next.reserve(scratch.size());
+        current.reserve(scratch.size());
+
+        auto enter = [&](EntityHandle h, EntityStore::Index index) {
+            Tracked t;
+            t.handle = h;
+            t.epoch = view.next_seq;
+            t.refreshed_at = view.updates;
+            view.changes.entered.push_back(h);
+            next.push_back(std::move(t));
+            current.push_back(store.ToEntity(index));
+        };
+
+        auto leave = [&](Tracked&& t) {
+            if (t.relevant) {
+                view.changes.left.push_back(t.handle);
+                t.relevant = false;
+                t.epoch = view.next_seq;
+            }
+            if (!t.created && !t.create_sent) return;  // Never reached the client
+            next.push_back(std::move(t));
+            current.emplace_back();
+        };
+
+        // Pass 1: merge the query against the tracked set
+        float r2 = view.radius * view.radius;
+        const float* xs = store.PositionsX();
+        const float* ys = store.PositionsY();
+        auto& tracked = view.tracked;
+        size_t i = 0;
+        for (EntityHandle h : scratch) {
+            while (i < tracked.size() && tracked[i].handle < h) leave(std::move(tracked[i++]));
+            bool known = i < tracked.size() && tracked[i].handle == h;
+            EntityStore::Index index = store.IndexOf(h);
+            if (index == EntityStore::INVALID_INDEX) {
+                // Grid not yet synced with a removal
+                if (known) leave(std::move(tracked[i++]));
+                continue;
+            }
 
+            float dx = xs[index] - view.focus.x, dy = ys[index] - view.focus.y;
+            bool inside = dx * dx + dy * dy <= r2;
+            if (!known) {
+                if (inside) enter(h, index);  // Not if only inside the hysteresis band
+                continue;
+            }
 
-// ============================================================================
-// HEROGAME.h - Game Framework
-// ============================================================================
+            Tracked t = std::move(tracked[i++]);
+            if (!t.relevant) {
+                if (inside) {
+                    enter(h, index);  // Back before the destroy was acked: create afresh
+                } else {
+                    next.push_back(std::move(t));
+                    current.emplace_back();
+                }
+                continue;
+            }
+            next.push_back(std::move(t));
+            current.push_back(store.ToEntity(index));
+        }
+        while (i < tracked.size()) leave(std::move(tracked[i++]));
+
+        // Destroys go out every Update() until acked (4 bytes each); creates
+        // and updates become candidates
+        static const Entity blank;
+        Stream creates(MagicWords::ENTITY_CREATE, tick);
+        Stream destroys(MagicWords::ENTITY_DESTROY, tick);
+        Stream updates(MagicWords::ENTITY_UPDATE, tick);
+        Output out;
+
+        for (size_t k = 0; k < next.size(); k++) {
+            Tracked& t = next[k];
+            const Entity& e = current[k];
+            if (!t.relevant) {
+                Begin(destroys, view, 32, out).WriteBits(t.handle.value, 32);
+                destroys.flight->records.push_back({t.handle, RecordKind::DESTROY});
+                continue;
+            }
+            float w = Weight(view, e);
+            if (!t.created) {
+                t.priority += w * weights.create;
+                uint8_t mask = Entity::DiffMask(blank, e);
+                candidates.push_back({t.priority, 32 + Entity::DeltaBits(blank, e, mask), mask, k});
+                continue;
+            }
+            uint8_t mask = FULL_MASK;
+            if (view.updates - t.refreshed_at < refresh_ticks && t.acked_seq >= t.forgotten) {
+                mask = Entity::DiffMask(t.acked, e);
+                for (const Pending& p : t.pending) mask |= Entity::PendingMask(t.acked, p.state, e);
+            }
+            if (mask) {
+                t.priority += w;
+                candidates.push_back({t.priority, 32 + Entity::DeltaBits(t.acked, e, mask), mask, k});
+            }
+        }
 
-#ifndef HEROGAME_H
-#define HEROGAME_H
+        // Pass 2: highest priority first, within the byte budget
+        size_t budget_bits = view.budget * 8;
+        if (view.budget) {
+            std::stable_sort(candidates.begin(), candidates.end(),
+                             [](const Candidate& a, const Candidate& b) { return a.priority > b.priority; });
+        }
+        size_t used_bits = 0;
+        bool first = true;
+        for (const Candidate& c : candidates) {
+            Tracked& t = next[c.slot];
+            if (view.budget && !first && used_bits + c.bits > budget_bits) {
+                view.changes.deferred++;
+                continue;
+            }
+            first = false;
+            used_bits += c.bits;
+            Stream& stream = t.created ? updates : creates;
+            BitWriter& w = Begin(stream, view, c.bits, out);
+            w.WriteBits(t.handle.value, 32);
+            if (t.created) {
+                Entity::WriteDelta(w, t.acked, current[c.slot], c.mask);
+                view.changes.updated++;
+            } else {
+                Entity::WriteDelta(w, blank, current[c.slot], c.mask);
+                t.create_sent = true;
+            }
+            if (!t.created || (c.mask & Entity::DELTA_REPLACE)) t.refreshed_at = view.updates;
+            t.priority = 0;
+            stream.flight->records.push_back({t.handle, t.created ? RecordKind::UPDATE : RecordKind::CREATE});
+            t.pending.push_back({stream.flight->seq, std::move(current[c.slot])});
+            if (t.pending.size() > MAX_PENDING_STATES) {
+                t.forgotten = t.pending.front().seq;
+                t.pending.erase(t.pending.begin());
+            }
+        }
 
-#include <cmath>
-#include <random>
+        Finish(creates, view, out);
+        Finish(destroys, view, out);
+        Finish(updates, view, out);
+        std::sort(out.begin(), out.end(),
+                  [](const auto& a, const auto& b) { return a.first < b.first; });
+        for (auto& [seq, msg] : out) messages.push_back(std::move(msg));
 
-namespace HERO {
-namespace Game {
+        view.tracked = std::move(next);
+        while (view.in_flight.size() > MAX_IN_FLIGHT) view.in_flight.pop_front();
+        return view.changes;
+    }
+};
 
 // ============================================================================
-// GAME STATE SYNCHRONIZATION
+// INTERPOLATION - Time-stamped motion samples for smooth rendering
 // ============================================================================
 
-class GameState {
-private:
-    std::unordered_map<std::string, std::string> state;
-    uint32_t version;
+enum class InterpolationMode { LINEAR, HERMITE };
 
+// Recent (time, position, velocity) samples for one entity. Sample() blends
+// the two samples around the requested time and dead-reckons past the
+// newest one for at most max_extrapolation_us.
+class InterpolationBuffer {
 public:
-    GameState() : version(0) {}
-
-    void Set(const std::string& key, const std::string& value) {
-        state[key] = value;
-        version++;
-    }
-
-    void Set(const std::string& key, int value) {
-        Set(key, std::to_string(value));
-    }
-
-    void Set(const std::string& key, float value) {
-        Set(key, std::to_string(value));
-    }
+    static constexpr size_t CAPACITY = 32;
 
-    void Set(const std::string& key, bool value) {
-        Set(key, value ? "true" : "false");
-    }
+private:
+    struct MotionSample {
+        int64_t time_us;
+        Vector2 position;
+        Vector2 velocity;
+    };
 
-    std::string Get(const std::string& key, const std::string& default_val = "") const {
-        auto it = state.find(key);
-        return (it != state.end()) ? it->second : default_val;
-    }
+    std::array<MotionSample, CAPACITY> samples;
+    size_t head;   // Next write slot
+    size_t count;
 
-    int GetInt(const std::string& key, int default_val = 0) const {
-        std::string val = Get(key);
-        return val.empty() ? default_val : std::stoi(val);
+    const MotionSample& At(size_t age) const {  // 0 = newest
+        return samples[(head + CAPACITY - 1 - age) % CAPACITY];
     }
 
-    float GetFloat(const std::string& key, float default_val = 0.0f) const {
-        std::string val = Get(key);
-        return val.empty() ? default_val : std::stof(val);
+public:
+    InterpolationBuffer() : samples(), head(0), count(0) {}
+
+    // Samples older than the newest are dropped; same-time samples replace it
+    void Push(int64_t time_us, const Vector2& position, const Vector2& velocity) {
+        if (count > 0 && time_us <= At(0).time_us) {
+            if (time_us < At(0).time_us) return;
+            head = (head + CAPACITY - 1) % CAPACITY;
+            count--;
+        }
+        samples[head] = {time_us, position, velocity};
+        head = (head + 1) % CAPACITY;
+        if (count < CAPACITY) count++;
     }
 
-    bool GetBool(const std::string& key, bool default_val = false) const {
-        std::string val = Get(key);
-        return val.empty() ? default_val : (val == "true");
-    }
+    bool Sample(int64_t time_us, InterpolationMode mode, int64_t max_extrapolation_us,
+                Vector2& position, Vector2& velocity) const {
+        if (count == 0) return false;
 
-    std::string Serialize() const {
-        std::stringstream ss;
-        ss << version << "|";
-        for (const auto& [key, value] : state) {
-            ss << key << "=" << value << ";";
+        const MotionSample& newest = At(0);
+        if (time_us >= newest.time_us) {
+            float ahead = std::min(time_us - newest.time_us, max_extrapolation_us) / 1e6f;
+            position = newest.position + newest.velocity * ahead;
+            velocity = newest.velocity;
+            return true;
         }
-        return ss.str();
-    }
-
-    void Deserialize(const std::string& data) {
-        state.clear();
-        size_t pipe_pos = data.find('|');
-        if (pipe_pos == std::string::npos) return;
 
-        version = std::stoul(data.substr(0, pipe_pos));
-        std::string pairs = data.substr(pipe_pos + 1);
+        for (size_t age = 1; age < count; age++) {
+            const MotionSample& a = At(age);
+            if (a.time_us > time_us) continue;
+            const MotionSample& b = At(age - 1);
+            float dt = (b.time_us - a.time_us) / 1e6f;
+            float t = (time_us - a.time_us) / 1e6f / dt;
+            if (mode == InterpolationMode::LINEAR) {
+                position = a.position + (b.position - a.position) * t;
+                velocity = a.velocity + (b.velocity - a.velocity) * t;
+            } else {
+                float t2 = t * t, t3 = t2 * t;
+                position = a.position * (2 * t3 - 3 * t2 + 1) + a.velocity * ((t3 - 2 * t2 + t) * dt) +
+                           b.position * (-2 * t3 + 3 * t2) + b.velocity * ((t3 - t2) * dt);
+                velocity = (a.position * (6 * t2 - 6 * t) + a.velocity * ((3 * t2 - 4 * t + 1) * dt) +
+                            b.position * (-6 * t2 + 6 * t) + b.velocity * ((3 * t2 - 2 * t) * dt)) * (1.0f / dt);
+            }
+            return true;
+        }
 
-        size_t pos = 0;
-        while (pos < pairs.length()) {
-            size_t eq = pairs.find('=', pos);
-            size_t semi = pairs.find(';', eq);
-            if (eq == std::string::npos || semi == std::string::npos) break;
+        // Older than everything buffered: hold the oldest sample
+        const MotionSample& oldest = At(count - 1);
+        position = oldest.position;
+        velocity = oldest.velocity;
+        return true;
+    }
 
-            std::string key = pairs.substr(pos, eq - pos);
-            std::string value = pairs.substr(eq + 1, semi - eq - 1);
-            state[key] = value;
+    size_t Size() const { return count; }
+    int64_t NewestTime() const { return count ? At(0).time_us : 0; }
 
-            pos = semi + 1;
-        }
+    void Clear() {
+        head = 0;
+        count = 0;
     }
-
-    uint32_t GetVersion() const { return version; }
 };
 
 // ============================================================================
-// VECTOR2 - Simple 2D vector for game math
+// PREDICTION - Sequenced player inputs and server-side input queue
 // ============================================================================
 
-struct Vector2 {
-    float x, y;
-
-    Vector2() : x(0), y(0) {}
-    Vector2(float x, float y) : x(x), y(y) {}
-
-    Vector2 operator+(const Vector2& other) const {
-        return Vector2(x + other.x, y + other.y);
+struct InputCommand {
+    static constexpr float MAX_DT = 0.1f;  // Longer steps are clamped on both ends
+
+    uint32_t seq = 0;
+    Vector2 move;
+    uint32_t buttons = 0;
+    float dt = 0;
+
+    // Binary, so the server simulates the exact floats the client predicted with
+    void Write(ByteWriter& w) const {
+        w.WriteVarUInt(seq);
+        w.WriteF32(move.x);
+        w.WriteF32(move.y);
+        w.WriteVarUInt(buttons);
+        w.WriteF32(dt);
     }
 
-    Vector2 operator-(const Vector2& other) const {
-        return Vector2(x - other.x, y - other.y);
+    bool Read(ByteReader& r) {
+        uint64_t s, b;
+        if (!r.ReadVarUInt(s) || !r.ReadF32(move.x) || !r.ReadF32(move.y) || !r.ReadVarUInt(b) || !r.ReadF32(dt)) {
+            return false;
+        }
+        seq = static_cast<uint32_t>(s);
+        buttons = static_cast<uint32_t>(b);
+        return true;
     }
 
-    Vector2 operator*(float scalar) const {
-        return Vector2(x * scalar, y * scalar);
+    static float ClampDt(float dt) {
+        return (dt > 0.0f) ? std::min(dt, MAX_DT) : 0.0f;  // NaN fails the test
     }
+};
 
-    float Length() const {
-        return std::sqrt(x * x + y * y);
-    }
+// Server side of prediction, one per player. Accept() takes an "INPUT"
+// binary command (which repeats recent unacked inputs to survive loss),
+// keeps only inputs newer than any seen, and Pop() hands them out in order.
+// Client time is not trusted: each input's dt is clamped to MAX_DT, and
+// Pop() stops once the inputs popped outrun the time credited by Tick(),
+// so sending inputs faster than real time does not move a player faster.
+// After simulating them, send MakeState() so the client can reconcile.
+class InputQueue {
+public:
+    static constexpr size_t MAX_PENDING = 64;
 
-    Vector2 Normalized() const {
-        float len = Length();
-        return len > 0 ? Vector2(x / len, y / len) : Vector2(0, 0);
-    }
+private:
+    std::deque<InputCommand> queue;
+    uint32_t last_received;
+    uint32_t last_processed;
+    float budget;
+    float max_banked;
 
-    float Distance(const Vector2& other) const {
-        return (*this - other).Length();
+public:
+    // `max_banked_seconds` of unused time carry over to absorb input jitter
+    explicit InputQueue(float max_banked_seconds = 0.25f)
+        : last_received(0), last_processed(0), budget(0),
+          max_banked(std::max(max_banked_seconds, InputCommand::MAX_DT)) {}
+
+    // Returns the number of new inputs queued
+    size_t Accept(const CommandView& cmd) {
+        if (!cmd.IsBinary()) return 0;
+        std::string_view args = cmd.Args();
+        ByteReader r(reinterpret_cast<const uint8_t*>(args.data()), args.size());
+        size_t added = 0;
+        InputCommand in;
+        while (r.Remaining() > 0 && in.Read(r)) {
+            if (in.seq <= last_received || queue.size() >= MAX_PENDING) continue;
+            in.dt = InputCommand::ClampDt(in.dt);
+            queue.push_back(in);
+            last_received = in.seq;
+            added++;
+        }
+        return added;
     }
 
-    std::string ToString() const {
-        return std::to_string(x) + "," + std::to_string(y);
+    // Credits one server tick of simulation time
+    void Tick(float dt) { budget = std::min(budget + dt, max_banked); }
+
+    bool Pop(InputCommand& out) {
+        if (queue.empty() || queue.front().dt > budget) return false;
+        out = queue.front();
+        queue.pop_front();
+        budget -= out.dt;
+        last_processed = out.seq;
+        return true;
     }
 
-    static Vector2 FromString(const std::string& str) {
-        size_t comma = str.find(',');
-        if (comma == std::string::npos) return Vector2();
-        return Vector2(std::stof(str.substr(0, comma)),
-                      std::stof(str.substr(comma + 1)));
+    uint32_t LastProcessed() const { return last_processed; }
+    size_t Pending() const { return queue.size(); }
+
+    // Binary "PSTATE": last processed seq, then Entity::WriteState(), so
+    // the client replays its unacked inputs from the server's exact floats
+    std::vector<uint8_t> MakeState(const Entity& player) const {
+        std::vector<uint8_t> out = {'P', 'S', 'T', 'A', 'T', 'E', CommandView::BINARY_MARK};
+        BitWriter w(out);
+        w.WriteBits(last_processed, 32);
+        player.WriteState(w);
+        w.Flush();
+        return out;
     }
 };
 
 // ============================================================================
-// ENTITY - Game object with position, velocity, and properties
+// LAG COMPENSATION - Rewindable per-tick entity position history
 // ============================================================================
 
-class Entity {
-public:
-    std::string id;
-    Vector2 position;
-    Vector2 velocity;
-    std::unordered_map<std::string, std::string> properties;
+struct RayHit {
+    EntityHandle handle;
+    float distance = 0;
+    Vector2 point;
+};
 
-    Entity(const std::string& id = "") : id(id) {}
+// Fixed-size ring of per-tick position frames stored as flat SoA arrays
+// (handle, x, y: 12 bytes per entity per tick) allocated once, so memory
+// is history_ticks * max_entities * 12 bytes whatever the load; entities
+// past max_entities are not recorded. Frames are sorted by handle, so a
+// single entity is found by binary search and area queries at fractional
+// ticks interpolate two frames in one merge walk.
+// Rewinds older than the history clamp to the oldest frame, which also
+// bounds how far a client can rewind.
+class LagCompensator {
+private:
+    struct Frame {
+        uint32_t tick = 0;
+        uint32_t count = 0;
+        bool valid = false;
+    };
 
-    void SetProperty(const std::string& key, const std::string& value) {
-        properties[key] = value;
+    size_t history;
+    size_t max_entities;
+    std::vector<Frame> frames;
+    std::vector<EntityHandle> frame_handles;
+    std::vector<float> frame_x;
+    std::vector<float> frame_y;
+    std::vector<uint32_t> order;
+    uint32_t latest_tick;
+
+    size_t Slot(uint32_t tick) const { return tick % history; }
+
+    const Frame* FindFrame(uint32_t tick) const {
+        const Frame& f = frames[Slot(tick)];
+        return (f.valid && f.tick == tick) ? &f : nullptr;
     }
 
-    std::string GetProperty(const std::string& key, const std::string& default_val = "") const {
-        auto it = properties.find(key);
-        return (it != properties.end()) ? it->second : default_val;
+    // Resolves a fractional tick to two recorded frames and a blend factor
+    bool Bracket(double tick, const Frame*& a, const Frame*& b, float& t) const {
+        if (!FindFrame(latest_tick)) return false;
+        uint32_t oldest = latest_tick >= history - 1 ? latest_tick - static_cast<uint32_t>(history - 1) : 0;
+        while (oldest < latest_tick && !FindFrame(oldest)) oldest++;
+
+        double clamped = std::max(static_cast<double>(oldest), std::min(static_cast<double>(latest_tick), tick));
+        uint32_t lo = static_cast<uint32_t>(clamped);
+        a = FindFrame(lo);
+        b = FindFrame(std::min(lo + 1, latest_tick));
+        t = static_cast<float>(clamped - lo);
+        if (!a) a = b;
+        if (!b) b = a;
+        return a != nullptr;
     }
 
-    void Update(float deltaTime) {
-        position = position + velocity * deltaTime;
+    // Position of `h` in frame `f`, by binary search over its sorted handles
+    bool FindIn(const Frame* f, EntityHandle h, float& x, float& y) const {
+        auto first = frame_handles.begin() + Slot(f->tick) * max_entities;
+        auto last = first + f->count;
+        auto it = std::lower_bound(first, last, h);
+        if (it == last || !(*it == h)) return false;
+        size_t i = static_cast<size_t>(it - frame_handles.begin());
+        x = frame_x[i];
+        y = frame_y[i];
+        return true;
     }
 
-    std::string Serialize() const {
-        std::stringstream ss;
-        ss << id << "|" << position.ToString() << "|" << velocity.ToString() << "|";
-        for (const auto& [key, value] : properties) {
-            ss << key << "=" << value << ";";
+    // f(handle, x, y) for every entity at the blended time
+    template<typename F>
+    void ForEachAt(const Frame* a, const Frame* b, float t, F&& f) const {
+        const size_t base_a = Slot(a->tick) * max_entities;
+        const size_t base_b = Slot(b->tick) * max_entities;
+        size_t i = 0, j = 0;
+        while (i < a->count || j < b->count) {
+            EntityHandle ha = i < a->count ? frame_handles[base_a + i] : EntityHandle();
+            EntityHandle hb = j < b->count ? frame_handles[base_b + j] : EntityHandle();
+            if (j == b->count || (i < a->count && ha < hb)) {
+                f(ha, frame_x[base_a + i], frame_y[base_a + i]);
+                i++;
+            } else if (i == a->count || hb < ha) {
+                f(hb, frame_x[base_b + j], frame_y[base_b + j]);
+                j++;
+            } else {
+                float ax = frame_x[base_a + i], ay = frame_y[base_a + i];
+                f(ha, ax + (frame_x[base_b + j] - ax) * t, ay + (frame_y[base_b + j] - ay) * t);
+                i++;
+                j++;
+            }
         }
-        return ss.str();
     }
 
-    static Entity Deserialize(const std::string& data) {
-        Entity e;
-        std::stringstream ss(data);
-        std::string part;
-        std::vector<std::string> parts;
-
-        while (std::getline(ss, part, '|')) {
-            parts.push_back(part);
+public:
+    // Defaults: 2 s at 60 Hz for up to 4096 entities (~5.9 MB)
+    explicit LagCompensator(size_t history_ticks = 120, size_t max_entity_count = 4096)
+        : history(std::max<size_t>(history_ticks, 2)), max_entities(std::max<size_t>(max_entity_count, 1)),
+          frames(history), frame_handles(history * max_entities), frame_x(history * max_entities),
+          frame_y(history * max_entities), latest_tick(0) {}
+
+    // Records the positions of every entity in `store` for `tick`
+    void Record(uint32_t tick, const EntityStore& store) {
+        Frame& frame = frames[Slot(tick)];
+        size_t n = std::min(store.Size(), max_entities);
+        const EntityHandle* handles = store.Handles();
+        order.resize(n);
+        for (uint32_t i = 0; i < n; i++) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](uint32_t x, uint32_t y) { return handles[x] < handles[y]; });
+
+        size_t base = Slot(tick) * max_entities;
+        const float* xs = store.PositionsX();
+        const float* ys = store.PositionsY();
+        for (size_t i = 0; i < n; i++) {
+            frame_handles[base + i] = handles[order[i]];
+            frame_x[base + i] = xs[order[i]];
+            frame_y[base + i] = ys[order[i]];
         }
+        frame.tick = tick;
+        frame.count = static_cast<uint32_t>(n);
+        frame.valid = true;
+        if (tick > latest_tick || !FindFrame(latest_tick)) latest_tick = tick;
+    }
 
-        if (parts.size() >= 1) e.id = parts[0];
-        if (parts.size() >= 2) e.position = Vector2::FromString(parts[1]);
-        if (parts.size() >= 3) e.velocity = Vector2::FromString(parts[2]);
-
-        if (parts.size() >= 4) {
-            std::string props = parts[3];
-            size_t pos = 0;
-            while (pos < props.length()) {
-                size_t eq = props.find('=', pos);
-                size_t semi = props.find(';', eq);
-                if (eq == std::string::npos || semi == std::string::npos) break;
-
-                std::string key = props.substr(pos, eq - pos);
-                std::string value = props.substr(eq + 1, semi - eq - 1);
-                e.properties[key] = value;
+    // The tick a client was looking at when it acted: its one-way latency
+    // plus its interpolation delay behind `current_tick`. Ticks are double
+    // so the fraction survives past 2^24 ticks (~77 h at 60 Hz).
+    static double ViewTick(uint32_t current_tick, int64_t one_way_us, int64_t interp_delay_us, float tick_rate) {
+        double behind = static_cast<double>(one_way_us + interp_delay_us) * tick_rate / 1e6;
+        return std::max(0.0, static_cast<double>(current_tick) - behind);
+    }
 
-                pos = semi + 1;
-            }
+    bool GetPosition(double tick, EntityHandle h, Vector2& out) const {
+        const Frame *a, *b;
+        float t;
+        if (!Bracket(tick, a, b, t)) return false;
+        float ax = 0, ay = 0, bx = 0, by = 0;
+        bool in_a = FindIn(a, h, ax, ay);
+        bool in_b = FindIn(b, h, bx, by);
+        if (in_a && in_b) {
+            out = Vector2(ax + (bx - ax) * t, ay + (by - ay) * t);
+        } else if (in_a || in_b) {
+            out = in_a ? Vector2(ax, ay) : Vector2(bx, by);  // Spawned or removed between the frames
         }
+        return in_a || in_b;
+    }
 
-        return e;
+    // Nearest entity (a circle of `hit_radius`) along the ray at `tick`
+    bool Raycast(double tick, const Vector2& origin, const Vector2& direction, float max_distance,
+                 float hit_radius, RayHit& hit, EntityHandle ignore = EntityHandle()) const {
+        const Frame *a, *b;
+        float t;
+        if (!Bracket(tick, a, b, t)) return false;
+        Vector2 dir = direction.Normalized();
+        float r2 = hit_radius * hit_radius;
+        bool found = false;
+        hit.distance = max_distance;
+        ForEachAt(a, b, t, [&](EntityHandle e, float x, float y) {
+            if (e == ignore) return;
+            float ox = x - origin.x, oy = y - origin.y;
+            float along = ox * dir.x + oy * dir.y;
+            float perp2 = ox * ox + oy * oy - along * along;
+            if (perp2 > r2) return;
+            float enter = along - std::sqrt(r2 - perp2);
+            if (enter < 0) enter = (ox * ox + oy * oy <= r2) ? 0 : enter;  // Origin inside the circle
+            if (enter < 0 || enter > hit.distance) return;
+            hit.handle = e;
+            hit.distance = enter;
+            found = true;
+        });
+        if (found) hit.point = origin + dir * hit.distance;
+        return found;
+    }
+
+    // Appends entities within `radius` of `center` at `tick` to `out`
+    size_t OverlapCircle(double tick, const Vector2& center, float radius, std::vector<EntityHandle>& out) const {
+        const Frame *a, *b;
+        float t;
+        if (!Bracket(tick, a, b, t)) return 0;
+        size_t before = out.size();
+        float r2 = radius * radius;
+        ForEachAt(a, b, t, [&](EntityHandle e, float x, float y) {
+            float dx = x - center.x, dy = y - center.y;
+            if (dx * dx + dy * dy <= r2) out.push_back(e);
+        });
+        return out.size() - before;
     }
+
+    uint32_t GetLatestTick() const { return latest_tick; }
+    size_t GetHistoryTicks() const { return history; }
+    size_t MemoryBytes() const { return history * max_entities * (sizeof(EntityHandle) + 2 * sizeof(float)); }
 };
 
 // ============================================================================
@@ -1008,12 +5228,192 @@ private:
     HeroClient client;
     std::string server_host;
     uint16_t server_port;
-    std::unordered_map<std::string, Entity> entities;
+    HandleMap<Entity> entities;
+    std::unordered_map<std::string, EntityHandle> names;
+    uint32_t next_local_handle;  // Generation-0 handles for name-only entities
     GameState state;
+    int64_t state_request_us;  // When the outstanding full-state request was sent; 0 if none
+    static constexpr int64_t STATE_REQUEST_TIMEOUT_US = 500000;
     std::string player_id;
+    SnapshotHistory snapshots;
+    uint32_t snapshot_tick;
+    uint32_t entity_seq;                // Newest InterestManager message applied
+    std::vector<uint32_t> entity_acks;  // Sent as one "ENTITY_ACK|" per Update()
+    HandleMap<InterpolationBuffer> motion;  // Stamped in server time
+    bool timeline_synced;
+    InterpolationMode interp_mode;
+    int64_t interp_delay_us;
+    int64_t max_extrapolation_us;
+
+    // Prediction: inputs [last_acked_input + 1, next_input) are unacked
+    static constexpr size_t INPUT_HISTORY = 128;
+    static constexpr size_t INPUT_REDUNDANCY = 4;
+    std::function<void(Entity&, const InputCommand&)> predictor;
+    std::array<InputCommand, INPUT_HISTORY> inputs;
+    uint32_t next_input;
+    uint32_t last_acked_input;
+    Entity predicted;
+    bool has_prediction;
+    Vector2 prediction_error;
+
+    // Authoritative player state: rewind to it, replay unacked inputs
+    void Reconcile(const CommandView& view) {
+        std::string_view args = view.Args();
+        BitReader r(reinterpret_cast<const uint8_t*>(args.data()), args.size());
+        uint32_t seq;
+        Entity state;
+        if (!r.ReadBits(seq, 32) || !state.ReadState(r)) return;
+        if (has_prediction && seq < last_acked_input) return;  // Reordered, older state
+
+        Vector2 before = predicted.position;
+        predicted = std::move(state);
+        last_acked_input = std::max(last_acked_input, seq);
+        uint32_t first = std::max<uint32_t>(last_acked_input + 1, next_input > INPUT_HISTORY ? next_input - INPUT_HISTORY : 1);
+        if (predictor) {
+            for (uint32_t s = first; s < next_input; s++) predictor(predicted, inputs[s % INPUT_HISTORY]);
+        }
+        prediction_error = has_prediction ? predicted.position - before : Vector2();
+        has_prediction = true;
+    }
+
+    // Samples are stamped with the server time of the tick that produced
+    // them, so network jitter does not bend the interpolated path. Without
+    // a tick (or before the server's tick rate is known) the estimated
+    // server time of arrival is used instead.
+    int64_t SampleTime(std::optional<uint32_t> tick) const {
+        const ClockSync& clock = client.GetClockSync();
+        int64_t now_us = LinkEstimator::NowMicros();
+        return (tick.has_value() && clock.HasTickRate()) ? clock.TickTime(*tick) : clock.ServerTime(now_us);
+    }
+
+    // Buffers stamped before clock sync are on the local timeline; drop them
+    void SyncTimeline() {
+        if (timeline_synced || !client.IsClockSynced()) return;
+        motion.Clear();
+        timeline_synced = true;
+    }
+
+    void RecordMotion(const Entity& e, int64_t time_us) {
+        InterpolationBuffer* buffer = motion.Find(e.handle);
+        if (!buffer) buffer = &motion.Insert(e.handle, InterpolationBuffer());
+        buffer->Push(time_us, e.position, e.velocity);
+    }
+
+    void EraseEntity(EntityHandle h) {
+        entities.Erase(h);
+        motion.Erase(h);
+    }
+
+    void StoreEntity(const Entity& e, int64_t time_us) {
+        if (!e.id.empty()) names[e.id] = e.handle;
+        entities.Insert(e.handle, e);
+        RecordMotion(e, time_us);
+    }
+
+    // Binary ENTITY_UPDATE / ENTITY_CREATE / ENTITY_DESTROY streams.
+    // InterestManager messages are applied in sequence order only (older
+    // ones arriving late are dropped unacked, and the server resends what
+    // they carried) and acked once fully read.
+    bool ApplyEntityCommand(const CommandView& view) {
+        std::string_view args = view.Args();
+        const uint8_t* data = reinterpret_cast<const uint8_t*>(args.data());
+        BitReader r(data, args.size());
+        bool more = false;
+        uint32_t raw, seq;
+        std::optional<uint32_t> tick;
+
+        bool is_update = view.Code() == MagicWords::Lookup(MagicWords::ENTITY_UPDATE);
+        bool is_create = view.Code() == MagicWords::Lookup(MagicWords::ENTITY_CREATE);
+        bool is_destroy = view.Code() == MagicWords::Lookup(MagicWords::ENTITY_DESTROY);
+        if (!is_update && !is_create && !is_destroy) return false;
+
+        if (is_update) {
+            bool is_snapshot;
+            if (!r.ReadBool(is_snapshot)) return true;
+            if (is_snapshot) {
+                AcceptSnapshot(snapshots.ApplyBinary(data, args.size()));
+                return true;
+            }
+        }
+        if (!r.ReadBits(seq, 32) || seq <= entity_seq) return true;
+        if (!is_destroy) {
+            bool has_tick;
+            uint32_t server_tick;
+            if (!r.ReadBool(has_tick)) return true;
+            if (has_tick) {
+                if (!r.ReadBits(server_tick, 32)) return true;
+                tick = server_tick;
+            }
+        }
+        entity_seq = seq;
+        int64_t time_us = SampleTime(tick);
+
+        if (is_update) {
+            Entity scratch;
+            while (r.ReadBool(more) && more && r.ReadBits(raw, 32)) {
+                EntityHandle h(raw);
+                Entity* live = entities.Find(h);
+                Entity& target = live ? *live : scratch;  // Unknown entities are read and dropped
+                int mask = target.ReadDelta(r);
+                if (mask < 0) return true;
+                if (!live) continue;
+                if ((mask & Entity::DELTA_NAME) && !live->id.empty()) names[live->id] = h;
+                if (mask & (Entity::DELTA_POSITION | Entity::DELTA_VELOCITY)) RecordMotion(*live, time_us);
+            }
+        } else if (is_create) {
+            while (r.ReadBool(more) && more && r.ReadBits(raw, 32)) {
+                Entity e;
+                e.handle = EntityHandle(raw);
+                if (e.ReadDelta(r) < 0) return true;
+                StoreEntity(e, time_us);
+            }
+        } else {
+            while (r.ReadBool(more) && more && r.ReadBits(raw, 32)) {
+                EraseEntity(EntityHandle(raw));
+            }
+        }
+        if (r.Ok()) entity_acks.push_back(seq);
+        return true;
+    }
+
+    // Acks the snapshot and, if it is the newest, brings live entities to it
+    // in place so existing Entity objects (and pointers to them) survive
+    void AcceptSnapshot(const Snapshot* snap) {
+        if (!snap) return;  // Baseline no longer held; the server falls back to full
+        client.Send("SNAP_ACK|" + std::to_string(snap->tick));
+        if (snap->tick <= snapshot_tick) return;
+        snapshot_tick = snap->tick;
+
+        std::vector<EntityHandle> gone;
+        entities.ForEach([&](EntityHandle h, const Entity&) {
+            if (snap->IndexOf(h) == snap->Size()) gone.push_back(h);
+        });
+        for (EntityHandle h : gone) EraseEntity(h);
+
+        int64_t time_us = SampleTime(snap->tick);
+        for (size_t i = 0; i < snap->Size(); i++) {
+            Entity e = snap->At(i);
+            Entity* live = entities.Find(e.handle);
+            if (!live) {
+                StoreEntity(e, time_us);
+                continue;
+            }
+            live->position = e.position;
+            live->velocity = e.velocity;
+            RecordMotion(e, time_us);
+            if (live->properties != e.properties) live->properties = e.properties;
+            if (live->id != e.id) {
+                live->id = e.id;
+                if (!e.id.empty()) names[e.id] = e.handle;
+            }
+        }
+    }
 
 public:
-    GameClient() : server_port(0) {}
+    GameClient()
+        : server_port(0), next_local_handle(1), state_request_us(0), snapshot_tick(0), entity_seq(0), timeline_synced(false), interp_mode(InterpolationMode::HERMITE),
+          interp_delay_us(100000), max_extrapolation_us(250000), inputs(), next_input(1),
+          last_acked_input(0), has_prediction(false) {}
 
     bool Connect(const std::string& host, uint16_t port, const std::string& player_name) {
         if (!client.Connect(host, port)) {
@@ -1023,6 +5423,7 @@ public:
         server_host = host;
         server_port = port;
         player_id = player_name;
+        entity_seq = 0;
         client.Send("JOIN|" + player_name);
         return true;
     }
@@ -1038,7 +5439,17 @@ public:
 
     void Update(std::function<void(const std::string&, const std::string&)> handler = nullptr) {
         Packet pkt;
-        while (client.Receive(pkt, 10)) {
+        while (client.Receive(pkt, 0)) {
+            SyncTimeline();
+            CommandView view(pkt.payload);
+            if (view.IsBinary()) {
+                if (view.Code() == "PSTATE") {
+                    Reconcile(view);
+                    continue;
+                }
+                if (ApplyEntityCommand(view)) continue;
+            }
+
             std::string msg(pkt.payload.begin(), pkt.payload.end());
 
             size_t pipe = msg.find('|');
@@ -1048,27 +5459,119 @@ public:
             std::string data = msg.substr(pipe + 1);
 
             if (cmd == "ENTITY") {
+                // Servers that predate handles send names only: key those by
+                // name under a client-local handle. Allocators never issue
+                // generation 0, so these cannot equal a server handle.
                 Entity e = Entity::Deserialize(data);
-                entities[e.id] = e;
-            } else if (cmd == "STATE") {
+                if (!e.handle && !e.id.empty()) {
+                    auto it = names.find(e.id);
+                    e.handle = (it != names.end() && entities.Find(it->second))
+                                   ? it->second
+                                   : EntityHandle::Make(next_local_handle++, 0);
+                }
+                if (e.handle) StoreEntity(e, SampleTime(std::nullopt));
+            } else if (cmd == "STATE" || cmd == MagicWords::STATE_FULL) {
                 state.Deserialize(data);
+                state_request_us = 0;
+            } else if (cmd == "SNAP") {
+                AcceptSnapshot(snapshots.Apply(data, state));
+            } else if (cmd == MagicWords::STATE_DELTA) {
+                // Missed an earlier delta: ask the server for a full state,
+                // once per timeout rather than once per undeliverable delta
+                if (!state.ApplyDelta(data)) {
+                    int64_t now_us = LinkEstimator::NowMicros();
+                    if (state_request_us == 0 || now_us - state_request_us >= STATE_REQUEST_TIMEOUT_US) {
+                        client.Send(MagicWords::STATE_FULL + "|" + std::to_string(state.GetVersion()));
+                        state_request_us = now_us;
+                    }
+                }
             } else if (handler) {
                 handler(cmd, data);
             }
         }
+
+        if (!entity_acks.empty()) {
+            std::string ack = "ENTITY_ACK|";
+            for (uint32_t seq : entity_acks) ack += std::to_string(seq) + ";";
+            client.Send(ack);
+            entity_acks.clear();
+        }
     }
 
+    Entity* GetEntity(EntityHandle handle) { return entities.Find(handle); }
+
+    // By optional name; the name index is only as fresh as the last update
     Entity* GetEntity(const std::string& id) {
-        auto it = entities.find(id);
-        return (it != entities.end()) ? &it->second : nullptr;
+        auto it = names.find(id);
+        if (it == names.end()) return nullptr;
+        Entity* e = entities.Find(it->second);
+        return (e && e->id == id) ? e : nullptr;
     }
 
-    const std::unordered_map<std::string, Entity>& GetEntities() const {
+    const HandleMap<Entity>& GetEntities() const {
         return entities;
     }
 
+    // Rendering: entities are shown `delay_ms` behind the estimated server
+    // time, blended between received states, and dead-reckoned for up to
+    // `max_extrapolation_ms` when updates stop arriving. Longer delays ride
+    // out lower send rates.
+    void SetInterpolationDelay(int delay_ms) { interp_delay_us = static_cast<int64_t>(delay_ms) * 1000; }
+    void SetInterpolationMode(InterpolationMode mode) { interp_mode = mode; }
+    void SetMaxExtrapolation(int max_ms) { max_extrapolation_us = static_cast<int64_t>(max_ms) * 1000; }
+
+    bool GetRenderState(EntityHandle handle, Vector2& position, Vector2& velocity,
+                        int64_t now_us = LinkEstimator::NowMicros()) const {
+        const InterpolationBuffer* buffer = motion.Find(handle);
+        int64_t render_us = client.GetClockSync().ServerTime(now_us) - interp_delay_us;
+        return buffer && buffer->Sample(render_us, interp_mode, max_extrapolation_us, position, velocity);
+    }
+
+    // Latest known position when nothing is buffered; the predicted
+    // position for the local player
+    Vector2 GetRenderPosition(EntityHandle handle) const {
+        if (has_prediction && handle == predicted.handle) return predicted.position;
+        Vector2 position, velocity;
+        if (GetRenderState(handle, position, velocity)) return position;
+        const Entity* e = entities.Find(handle);
+        return e ? e->position : Vector2();
+    }
+
+    // Client-side prediction. `step` must be the same movement code the
+    // server runs for each InputCommand popped from its InputQueue.
+    void SetPredictor(std::function<void(Entity&, const InputCommand&)> step) { predictor = std::move(step); }
+
+    // Applies the input locally right away and sends it (with the previous
+    // few unacked inputs, to survive loss) as a binary "INPUT" command.
+    // dt is clamped as the server will clamp it. Returns its seq.
+    uint32_t SendInput(const Vector2& move, uint32_t buttons, float dt) {
+        InputCommand& in = inputs[next_input % INPUT_HISTORY];
+        in.seq = next_input++;
+        in.move = move;
+        in.buttons = buttons;
+        in.dt = InputCommand::ClampDt(dt);
+        if (predictor) predictor(predicted, in);
+
+        std::vector<uint8_t> msg = {'I', 'N', 'P', 'U', 'T', CommandView::BINARY_MARK};
+        ByteWriter w(msg);
+        uint32_t oldest = std::max<uint32_t>(last_acked_input + 1,
+                                             in.seq >= INPUT_REDUNDANCY ? in.seq - INPUT_REDUNDANCY + 1 : 1);
+        for (uint32_t s = oldest; s <= in.seq; s++) inputs[s % INPUT_HISTORY].Write(w);
+        client.Send(msg);
+        return in.seq;
+    }
+
+    const Entity& GetPredictedPlayer() const { return predicted; }
+    bool HasPrediction() const { return has_prediction; }
+    uint32_t GetLastAckedInput() const { return last_acked_input; }
+    size_t GetPendingInputCount() const { return next_input - 1 - last_acked_input; }
+
+    // How far the last reconciliation moved the predicted player
+    Vector2 GetPredictionError() const { return prediction_error; }
+
     GameState& GetState() { return state; }
     const std::string& GetPlayerId() const { return player_id; }
+    uint32_t GetSnapshotTick() const { return snapshot_tick; }
 };
 
 // ============================================================================